@@ -0,0 +1,353 @@
+#ifndef OPERATINGSYSTEMSCLASS_CHUNKEDWORLD_H
+#define OPERATINGSYSTEMSCLASS_CHUNKEDWORLD_H
+
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "ParticleArrays.h"
+#include "CollisionSolver.h"
+
+/*
+ * Particle store for worlds that do not fit in RAM.
+ *
+ * The world is cut into square chunks, each one a file holding a small header and
+ * the chunk's particles as SoA arrays, mapped with mmap(MAP_SHARED). Only metadata
+ * (count, awake count, residency) is kept per chunk in memory, so a billion idle
+ * particles cost disk, not RAM. Each step:
+ *
+ *  -> active chunks (with at least one awake particle) plus their 8 neighbours
+ *     form the working set, mapped if needed
+ *  -> their particles are gathered into one ParticleArrays and stepped by the solver
+ *  -> results are scattered back, particles that crossed a chunk border migrate
+ *  -> the ring around the working set is mapped and madvise(MADV_WILLNEED)'d, so
+ *     the kernel reads it in before activity spreads there
+ *  -> chunks that stayed dormant and out of the working set for a while are
+ *     msync'd and unmapped, their pages left for the kernel to reclaim
+ *
+ * A particle is asleep once it moved less than SLEEP_DISTANCE for SLEEP_STEPS
+ * consecutive steps. Dormant neighbours take part in the step unchanged, so a
+ * particle waking them up sees them as obstacles straight away.
+ *
+ * Files are only open while being created, mapped or grown, and a bulk load keeps
+ * just the chunk it is filling mapped, so a world of millions of chunks stays within
+ * RLIMIT_NOFILE and vm.max_map_count. Loading is cheapest grouped by chunk.
+ */
+class ChunkedWorld {
+public:
+    static constexpr uint16_t SLEEP_STEPS = 60;
+    static constexpr float SLEEP_DISTANCE = 1e-3f;
+    static constexpr uint64_t EVICT_AFTER_STEPS = 120;
+    static constexpr uint32_t INITIAL_CAPACITY = 1024;
+    // x, y, vx, vy and the steps at rest
+    static constexpr size_t PARTICLE_BYTES = 4 * sizeof(float) + sizeof(uint16_t);
+
+    ChunkedWorld(std::string directory, float chunkSize, const SolverConfig& config)
+            : directory(std::move(directory)), chunkSize(chunkSize), solver(config) {
+        std::filesystem::create_directories(this->directory);
+    }
+
+    ~ChunkedWorld() {
+        for (auto& [key, chunk] : chunks) {
+            unmap(chunk);
+        }
+    }
+
+    ChunkedWorld(const ChunkedWorld&) = delete;
+    ChunkedWorld& operator=(const ChunkedWorld&) = delete;
+
+    // Particles start asleep, only awake ones put their chunk in the next step's working
+    // set. Moving on to another chunk unmaps the previous one if nothing in it is awake.
+    void addParticle(float x, float y, float vx, float vy, bool awake = false) {
+        Chunk& chunk = chunkAt(keyOf(x, y));
+        if (loading && loading != &chunk && loading->awake == 0) unmap(*loading);
+        loading = &chunk;
+        append(chunk, x, y, vx, vy, awake ? 0 : SLEEP_STEPS);
+        if (awake) {
+            chunk.awake++;
+            chunk.lastActiveStep = stepIndex;
+        }
+    }
+
+    void step() {
+        stepIndex++;
+        collectWorkingSet();
+        gather();
+        solver.step(working);
+        scatter();
+        prefetchAndEvict();
+    }
+
+    [[nodiscard]] size_t particleCount() const {
+        size_t total = 0;
+        for (auto& [key, chunk] : chunks) total += chunk.count;
+        return total;
+    }
+
+    [[nodiscard]] size_t chunkCount() const { return chunks.size(); }
+
+    // Size of all the chunk files together
+    [[nodiscard]] size_t fileBytes() const {
+        size_t total = 0;
+        for (auto& [key, chunk] : chunks) total += bytesFor(chunk.capacity);
+        return total;
+    }
+
+    [[nodiscard]] size_t residentChunks() const {
+        return std::count_if(chunks.begin(), chunks.end(), [](auto& c) { return c.second.base != nullptr; });
+    }
+
+    // Particles stepped in the last call, the part of the world the solver actually touched
+    [[nodiscard]] const ParticleArrays& workingSet() const { return working; }
+
+private:
+    struct ChunkHeader {
+        uint32_t magic;
+        uint32_t count;
+        uint32_t capacity;
+        uint32_t awake;
+    };
+
+    struct Chunk {
+        int32_t cx{}, cy{};
+        uint8_t* base = nullptr;
+        size_t mappedBytes{};
+        uint32_t count{}, capacity{}, awake{};
+        uint64_t lastActiveStep{};
+
+        [[nodiscard]] float* x() const { return reinterpret_cast<float*>(base + HEADER_BYTES); }
+        [[nodiscard]] float* y() const { return x() + capacity; }
+        [[nodiscard]] float* vx() const { return y() + capacity; }
+        [[nodiscard]] float* vy() const { return vx() + capacity; }
+        [[nodiscard]] uint16_t* rest() const { return reinterpret_cast<uint16_t*>(vy() + capacity); }
+    };
+
+    static constexpr uint32_t MAGIC = 0x4b4e4843; // "CHNK"
+    static constexpr size_t HEADER_BYTES = 64;
+
+    static size_t bytesFor(uint32_t capacity) {
+        size_t bytes = HEADER_BYTES + size_t(capacity) * PARTICLE_BYTES;
+        size_t page = size_t(sysconf(_SC_PAGESIZE));
+        return (bytes + page - 1) / page * page;
+    }
+
+    static uint64_t pack(int32_t cx, int32_t cy) {
+        return uint64_t(uint32_t(cy)) << 32 | uint32_t(cx);
+    }
+
+    [[nodiscard]] uint64_t keyOf(float x, float y) const {
+        return pack(int32_t(std::floor(x / chunkSize)), int32_t(std::floor(y / chunkSize)));
+    }
+
+    [[nodiscard]] std::string pathOf(const Chunk& chunk) const {
+        return directory + "/chunk_" + std::to_string(chunk.cx) + "_" + std::to_string(chunk.cy) + ".bin";
+    }
+
+    static void fail(const char* what) {
+        std::cout << "ERROR::CHUNKEDWORLD::" << what << "\n" << std::strerror(errno) << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    // The chunk's file opened read-write; flags add O_CREAT | O_TRUNC for new chunks
+    int openFile(const Chunk& chunk, int flags = 0) const {
+        int fd = open(pathOf(chunk).c_str(), O_RDWR | flags, 0644);
+        if (fd < 0) fail("OPEN_FAILED");
+        return fd;
+    }
+
+    Chunk& chunkAt(uint64_t key) {
+        auto [it, created] = chunks.try_emplace(key);
+        Chunk& chunk = it->second;
+        if (created) {
+            chunk.cx = int32_t(uint32_t(key));
+            chunk.cy = int32_t(uint32_t(key >> 32));
+            chunk.capacity = INITIAL_CAPACITY;
+            // A fresh world never reuses chunk files left over by an earlier run
+            int fd = openFile(chunk, O_CREAT | O_TRUNC);
+            if (ftruncate(fd, off_t(bytesFor(chunk.capacity))) != 0) fail("TRUNCATE_FAILED");
+            close(fd);
+        }
+        map(chunk);
+        return chunk;
+    }
+
+    // The mapping keeps the file referenced, so the descriptor is closed straight away
+    void map(Chunk& chunk) {
+        if (chunk.base) return;
+        int fd = openFile(chunk);
+        chunk.mappedBytes = bytesFor(chunk.capacity);
+        void* base = mmap(nullptr, chunk.mappedBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (base == MAP_FAILED) fail("MMAP_FAILED");
+        chunk.base = static_cast<uint8_t*>(base);
+        auto* header = reinterpret_cast<ChunkHeader*>(chunk.base);
+        *header = {MAGIC, chunk.count, chunk.capacity, chunk.awake};
+    }
+
+    void unmap(Chunk& chunk) {
+        if (chunk.base) {
+            auto* header = reinterpret_cast<ChunkHeader*>(chunk.base);
+            *header = {MAGIC, chunk.count, chunk.capacity, chunk.awake};
+            msync(chunk.base, chunk.mappedBytes, MS_ASYNC);
+            munmap(chunk.base, chunk.mappedBytes);
+            chunk.base = nullptr;
+        }
+    }
+
+    // The arrays start at offsets that depend on the capacity, so after growing the
+    // file they are moved up, last array first, to their new offsets.
+    void grow(Chunk& chunk) {
+        uint32_t oldCapacity = chunk.capacity;
+        uint32_t newCapacity = oldCapacity * 2;
+        size_t newBytes = bytesFor(newCapacity);
+        int fd = openFile(chunk);
+        if (ftruncate(fd, off_t(newBytes)) != 0) fail("TRUNCATE_FAILED");
+        close(fd);
+        void* base = mremap(chunk.base, chunk.mappedBytes, newBytes, MREMAP_MAYMOVE);
+        if (base == MAP_FAILED) fail("MREMAP_FAILED");
+        chunk.base = static_cast<uint8_t*>(base);
+        chunk.mappedBytes = newBytes;
+
+        uint8_t* arrays = chunk.base + HEADER_BYTES;
+        const size_t floatBytes = oldCapacity * sizeof(float);
+        std::memmove(arrays + 4 * newCapacity * sizeof(float), arrays + 4 * floatBytes, oldCapacity * sizeof(uint16_t));
+        for (int a = 3; a >= 1; a--) {
+            std::memmove(arrays + a * newCapacity * sizeof(float), arrays + a * floatBytes, floatBytes);
+        }
+        chunk.capacity = newCapacity;
+    }
+
+    void append(Chunk& chunk, float x, float y, float vx, float vy, uint16_t rest) {
+        if (chunk.count == chunk.capacity) grow(chunk);
+        uint32_t slot = chunk.count++;
+        chunk.x()[slot] = x;
+        chunk.y()[slot] = y;
+        chunk.vx()[slot] = vx;
+        chunk.vy()[slot] = vy;
+        chunk.rest()[slot] = rest;
+    }
+
+    template<class Fn>
+    void forEachNeighbour(const Chunk& chunk, int ring, Fn&& fn) {
+        for (int dy = -ring; dy <= ring; dy++) {
+            for (int dx = -ring; dx <= ring; dx++) {
+                auto it = chunks.find(pack(chunk.cx + dx, chunk.cy + dy));
+                if (it != chunks.end()) fn(it->second);
+            }
+        }
+    }
+
+    void collectWorkingSet() {
+        active.clear();
+        for (auto& [key, chunk] : chunks) {
+            if (chunk.awake > 0) active.push_back(&chunk);
+        }
+
+        workingChunks.clear();
+        for (Chunk* chunk : active) {
+            forEachNeighbour(*chunk, 1, [&](Chunk& neighbour) {
+                if (neighbour.lastActiveStep == stepIndex) return;
+                neighbour.lastActiveStep = stepIndex;
+                workingChunks.push_back(&neighbour);
+            });
+        }
+    }
+
+    void gather() {
+        working.resize(0);
+        originSlot.clear();
+        for (Chunk* chunk : workingChunks) {
+            map(*chunk);
+            for (uint32_t slot = 0; slot < chunk->count; slot++) {
+                working.push(chunk->x()[slot], chunk->y()[slot], chunk->vx()[slot], chunk->vy()[slot]);
+                originSlot.push_back(slot);
+            }
+        }
+        startX = working.x;
+        startY = working.y;
+    }
+
+    void scatter() {
+        migrants.clear();
+        size_t p = 0;
+        for (Chunk* chunk : workingChunks) {
+            const uint64_t key = pack(chunk->cx, chunk->cy);
+            uint32_t kept = 0, awake = 0;
+            for (uint32_t n = chunk->count; n > 0; n--, p++) {
+                const uint16_t rest = nextRest(p, chunk->rest()[originSlot[p]]);
+                if (keyOf(working.x[p], working.y[p]) != key) {
+                    migrants.push_back({p, rest});
+                    continue;
+                }
+                // kept never passes the slot being read, so compacting in place is safe
+                chunk->x()[kept] = working.x[p];
+                chunk->y()[kept] = working.y[p];
+                chunk->vx()[kept] = working.vx[p];
+                chunk->vy()[kept] = working.vy[p];
+                chunk->rest()[kept] = rest;
+                awake += rest < SLEEP_STEPS;
+                kept++;
+            }
+            chunk->count = kept;
+            chunk->awake = awake;
+        }
+
+        for (auto [p, rest] : migrants) {
+            Chunk& target = chunkAt(keyOf(working.x[p], working.y[p]));
+            append(target, working.x[p], working.y[p], working.vx[p], working.vy[p], rest);
+            target.awake += rest < SLEEP_STEPS;
+            target.lastActiveStep = stepIndex;
+        }
+    }
+
+    [[nodiscard]] uint16_t nextRest(size_t p, uint16_t rest) const {
+        float dx = working.x[p] - startX[p], dy = working.y[p] - startY[p];
+        if (dx * dx + dy * dy > SLEEP_DISTANCE * SLEEP_DISTANCE) return 0;
+        return std::min<uint16_t>(rest + 1, SLEEP_STEPS);
+    }
+
+    void prefetchAndEvict() {
+        for (auto& [key, chunk] : chunks) {
+            if (chunk.awake == 0) continue;
+            forEachNeighbour(chunk, 2, [&](Chunk& ahead) {
+                // Refreshed even when already mapped, or it would be evicted and mapped again every step
+                ahead.lastActiveStep = stepIndex;
+                if (ahead.base) return;
+                map(ahead);
+                madvise(ahead.base, ahead.mappedBytes, MADV_WILLNEED);
+            });
+        }
+
+        for (auto& [key, chunk] : chunks) {
+            if (chunk.base && chunk.awake == 0 && stepIndex - chunk.lastActiveStep > EVICT_AFTER_STEPS) {
+                unmap(chunk);
+            }
+        }
+    }
+
+    std::string directory;
+    float chunkSize;
+    CollisionSolver solver;
+    uint64_t stepIndex{};
+
+    // Chunk addresses must stay stable while stepping, which unordered_map guarantees
+    std::unordered_map<uint64_t, Chunk> chunks;
+    Chunk* loading = nullptr; // the chunk addParticle last filled
+    std::vector<Chunk*> active, workingChunks;
+    ParticleArrays working;
+    std::vector<float> startX, startY;
+    // Slot each working set particle was gathered from, in its chunk
+    std::vector<uint32_t> originSlot;
+    std::vector<std::pair<size_t, uint16_t>> migrants;
+};
+
+#endif //OPERATINGSYSTEMSCLASS_CHUNKEDWORLD_H
@@ -0,0 +1,638 @@
+#ifndef OPERATINGSYSTEMSCLASS_COLLISIONSOLVER_H
+#define OPERATINGSYSTEMSCLASS_COLLISIONSOLVER_H
+
+#include <experimental/simd>
+#include <vector>
+#include <cmath>
+#include <limits>
+#include <cstdint>
+#include <functional>
+#include <numeric>
+#include <span>
+#include "ParticleArrays.h"
+#include "Scalar.h"
+#include "UniformGrid.h"
+#include "HashedGrid.h"
+#include "SweepAndPrune.h"
+#include "TaskGraph.h"
+#include "ThreadPool.h"
+
+namespace stdx = std::experimental;
+using floatv = stdx::native_simd<float>;
+// Fixed32 kernels: raw positions, and the squared distances that need 64 bits
+using fixedv = stdx::native_simd<int32_t>;
+using fixedWidev = stdx::rebind_simd_t<int64_t, fixedv>;
+
+enum class BoundaryMode {
+    Wall,     // reflect at 0 and width/height
+    Periodic, // leave through one side, come back through the other
+    Open,     // unbounded, only usable with the hashed grid in practice
+};
+
+enum class GridMode {
+    Dense,  // cells cover width x height, cheapest when the domain is mostly filled
+    Hashed, // only occupied cells are stored, for huge or unbounded sparse worlds
+};
+
+enum class BroadPhase {
+    Grid,          // the grid picked by gridMode
+    SweepAndPrune, // sorted along the axis of largest spread, for long thin scenes
+};
+
+struct SolverConfig {
+    float width{}, height{};
+    float radius{};
+    BoundaryMode boundaryX = BoundaryMode::Wall;
+    BoundaryMode boundaryY = BoundaryMode::Wall;
+    GridMode gridMode = GridMode::Dense;
+    // Dense grid only: re-bin just the particles that changed cell between steps
+    bool incrementalBinning = true;
+    BroadPhase broadPhase = BroadPhase::Grid;
+};
+
+// Called with the indices of a region of particles once the step is done with them, and the worker
+using RegionFn = std::function<void(std::span<const uint32_t>, unsigned)>;
+
+// Periodic axes have to fit three grid cells of one radius, the grids exit on anything
+// shorter, so check configs that come from outside before handing them to setConfig
+inline bool periodsFit(const SolverConfig& config) {
+    auto fits = [&](BoundaryMode mode, float extent) {
+        return mode != BoundaryMode::Periodic || extent >= 3 * config.radius;
+    };
+    return fits(config.boundaryX, config.width) && fits(config.boundaryY, config.height);
+}
+
+// Minimum image constants for one axis: period 0 turns the correction into a no-op,
+// so wall and periodic axes run exactly the same instructions in the kernel.
+template<class S>
+struct BasicAxisImage {
+    S period{}, invPeriod{};
+};
+
+using AxisImage = BasicAxisImage<float>;
+
+// Confirmed contacts found by one run of pair generation, as pairs of grid slots
+struct ContactBuffer {
+    std::vector<uint32_t> a, b;
+
+    [[nodiscard]] size_t size() const { return a.size(); }
+
+    void clear() {
+        a.clear();
+        b.clear();
+    }
+};
+
+/*
+ * Pair generation: tests slot a against the slots [begin, end), one SIMD register of
+ * slots per iteration, and appends the pairs closer than radius to out. Out of range
+ * lanes of the last register are loaded as NaN, which fails both comparisons.
+ */
+template<class S> requires std::is_floating_point_v<S>
+void findContacts(uint32_t a, const S* sx, const S* sy, uint32_t begin, uint32_t end,
+                  S radius, BasicAxisImage<S> ix, BasicAxisImage<S> iy, ContactBuffer& out) {
+    using V = stdx::native_simd<S>;
+    constexpr S nan = std::numeric_limits<S>::quiet_NaN();
+    const S r2 = radius * radius;
+    const S px = sx[a], py = sy[a];
+
+    for (uint32_t j = begin; j < end; j += V::size()) {
+        V ox, oy;
+        if (j + V::size() <= end) {
+            ox.copy_from(sx + j, stdx::element_aligned);
+            oy.copy_from(sy + j, stdx::element_aligned);
+        } else {
+            ox = V([&](auto l) { return j + l < end ? sx[j + l] : nan; });
+            oy = V([&](auto l) { return j + l < end ? sy[j + l] : nan; });
+        }
+
+        V dx = px - ox;
+        V dy = py - oy;
+        dx -= ix.period * stdx::round(dx * ix.invPeriod);
+        dy -= iy.period * stdx::round(dy * iy.invPeriod);
+
+        V d2 = dx * dx + dy * dy;
+        // d2 > 0 skips coincident particles, as the ordered pair loop used to
+        auto hit = d2 < r2 && d2 > S(0);
+        if (stdx::none_of(hit)) continue;
+        for (int l = stdx::find_first_set(hit), last = stdx::find_last_set(hit); l <= last; l++) {
+            if (!hit[l]) continue;
+            out.a.push_back(a);
+            out.b.push_back(j + l);
+        }
+    }
+}
+
+// Minimum image of raw offsets between positions in [0, period); period 0 leaves them alone
+inline fixedv minimumImage(fixedv d, int32_t period) {
+    const int32_t half = period / 2;
+    stdx::where(d > half, d) -= period;
+    stdx::where(d < -half, d) += period;
+    return d;
+}
+
+/*
+ * Fixed32 pair generation, all integer: offsets in 32 bit lanes, a cull on each axis,
+ * and only registers with a lane inside the radius on both widened for the exact
+ * 64 bit squared distance.
+ */
+inline void findContacts(uint32_t a, const Fixed32* sx, const Fixed32* sy, uint32_t begin, uint32_t end,
+                         Fixed32 radius, BasicAxisImage<Fixed32> ix, BasicAxisImage<Fixed32> iy, ContactBuffer& out) {
+    const int32_t* rx = &sx->raw;
+    const int32_t* ry = &sy->raw;
+    const int32_t r = radius.raw, px = rx[a], py = ry[a];
+    const int64_t r2 = int64_t(r) * r;
+
+    for (uint32_t j = begin; j < end; j += fixedv::size()) {
+        fixedv ox, oy;
+        if (j + fixedv::size() <= end) {
+            ox.copy_from(rx + j, stdx::element_aligned);
+            oy.copy_from(ry + j, stdx::element_aligned);
+        } else {
+            // Out of range lanes sit on a itself, which fails d2 > 0
+            ox = fixedv([&](auto l) { return j + l < end ? rx[j + l] : px; });
+            oy = fixedv([&](auto l) { return j + l < end ? ry[j + l] : py; });
+        }
+
+        fixedv dx = minimumImage(px - ox, ix.period.raw);
+        fixedv dy = minimumImage(py - oy, iy.period.raw);
+        if (stdx::none_of(stdx::abs(dx) < r && stdx::abs(dy) < r)) continue;
+
+        const auto wx = stdx::static_simd_cast<fixedWidev>(dx), wy = stdx::static_simd_cast<fixedWidev>(dy);
+        fixedWidev d2 = wx * wx + wy * wy;
+        auto hit = d2 < r2 && d2 > 0;
+        if (stdx::none_of(hit)) continue;
+        for (int l = stdx::find_first_set(hit), last = stdx::find_last_set(hit); l <= last; l++) {
+            if (!hit[l]) continue;
+            out.a.push_back(a);
+            out.b.push_back(j + l);
+        }
+    }
+}
+
+/*
+ * Resolution: contacts [begin, end) of a buffer in batches of one SIMD register. Slot
+ * positions are gathered, the pushes computed in registers and stored per contact,
+ * slot a moving by +move and slot b by -move. Nothing is scattered here, so the order
+ * the moves are added up in is left to the caller.
+ */
+template<class S> requires std::is_floating_point_v<S>
+void resolveContacts(const ContactBuffer& contacts, size_t begin, size_t end, const S* sx, const S* sy,
+                     S radius, BasicAxisImage<S> ix, BasicAxisImage<S> iy, S* moveX, S* moveY) {
+    using V = stdx::native_simd<S>;
+    constexpr size_t W = V::size();
+    for (size_t k = begin; k < end; k += W) {
+        const size_t lanes = std::min(W, end - k);
+        // Lanes past the end repeat the last contact and are never scattered
+        auto lane = [&](size_t l) { return k + std::min(l, lanes - 1); };
+        V ax([&](auto l) { return sx[contacts.a[lane(l)]]; });
+        V ay([&](auto l) { return sy[contacts.a[lane(l)]]; });
+        V bx([&](auto l) { return sx[contacts.b[lane(l)]]; });
+        V by([&](auto l) { return sy[contacts.b[lane(l)]]; });
+
+        V dx = ax - bx;
+        V dy = ay - by;
+        dx -= ix.period * stdx::round(dx * ix.invPeriod);
+        dy -= iy.period * stdx::round(dy * iy.invPeriod);
+        V d = stdx::sqrt(dx * dx + dy * dy);
+        V push = (radius - d) * S(0.5) / d;
+        V mx = dx * push, my = dy * push;
+
+        if (lanes == W) {
+            mx.copy_to(moveX + k, stdx::element_aligned);
+            my.copy_to(moveY + k, stdx::element_aligned);
+        } else {
+            for (size_t l = 0; l < lanes; l++) {
+                moveX[k + l] = mx[l];
+                moveY[k + l] = my[l];
+            }
+        }
+    }
+}
+
+// Fixed32 resolution: offsets and squared distances in SIMD as above, then an exact
+// integer square root and push per contact. The push's division truncates towards
+// zero, so a moves by exactly what b moves back.
+inline void resolveContacts(const ContactBuffer& contacts, size_t begin, size_t end, const Fixed32* sx,
+                            const Fixed32* sy, Fixed32 radius, BasicAxisImage<Fixed32> ix,
+                            BasicAxisImage<Fixed32> iy, Fixed32* moveX, Fixed32* moveY) {
+    constexpr size_t W = fixedv::size();
+    for (size_t k = begin; k < end; k += W) {
+        const size_t lanes = std::min(W, end - k);
+        auto lane = [&](size_t l) { return k + std::min(l, lanes - 1); };
+        fixedv ax([&](auto l) { return sx[contacts.a[lane(l)]].raw; });
+        fixedv ay([&](auto l) { return sy[contacts.a[lane(l)]].raw; });
+        fixedv bx([&](auto l) { return sx[contacts.b[lane(l)]].raw; });
+        fixedv by([&](auto l) { return sy[contacts.b[lane(l)]].raw; });
+
+        const auto wx = stdx::static_simd_cast<fixedWidev>(minimumImage(ax - bx, ix.period.raw));
+        const auto wy = stdx::static_simd_cast<fixedWidev>(minimumImage(ay - by, iy.period.raw));
+        fixedWidev d2 = wx * wx + wy * wy;
+
+        for (size_t l = 0; l < lanes; l++) {
+            const int64_t d = integerSqrt(d2[l]);
+            moveX[k + l] = Fixed32::fromRaw(int32_t(wx[l] * (radius.raw - d) / (2 * d)));
+            moveY[k + l] = Fixed32::fromRaw(int32_t(wy[l] * (radius.raw - d) / (2 * d)));
+        }
+    }
+}
+
+/*
+ * Steps particles of scalar S: float, double or Fixed32 (see Scalar.h). The config
+ * stays in float whatever S is and is converted once per setConfig; positions,
+ * velocities and everything computed from them are S.
+ */
+template<class S>
+class BasicCollisionSolver {
+public:
+    using Coord = CellScalar<S>;
+
+    explicit BasicCollisionSolver(const SolverConfig& config) {
+        setConfig(config);
+    }
+
+    void setConfig(const SolverConfig& newConfig) {
+        config = newConfig;
+        width = S(config.width);
+        height = S(config.height);
+        radius = S(config.radius);
+        bool periodicX = config.boundaryX == BoundaryMode::Periodic;
+        bool periodicY = config.boundaryY == BoundaryMode::Periodic;
+        if (config.gridMode == GridMode::Dense) {
+            denseGrid.configure(config.width, config.height, config.radius, periodicX, periodicY);
+            denseGrid.setIncremental(config.incrementalBinning);
+        } else {
+            hashedGrid.configure(config.width, config.height, config.radius, periodicX, periodicY);
+        }
+        sweep.configure(width, height, radius, periodicX, periodicY);
+    }
+
+    // Bins into a dense grid over [x0, x1] x [y0, y1] instead of the world, for stepping a
+    // small piece of a big world; particles outside share the edge cells. Until the next
+    // setConfig. A periodic axis has to keep its whole period.
+    void setGridWindow(Coord x0, Coord y0, Coord x1, Coord y1) {
+        config.gridMode = GridMode::Dense;
+        config.broadPhase = BroadPhase::Grid;
+        denseGrid.configure(x1 - x0, y1 - y0, config.radius, config.boundaryX == BoundaryMode::Periodic,
+                            config.boundaryY == BoundaryMode::Periodic, x0, y0);
+        denseGrid.setIncremental(config.incrementalBinning);
+    }
+
+    void step(BasicParticleArrays<S>& state) {
+        step(state.view(), nullptr);
+    }
+
+    void step(BasicParticleArrays<S>& state, ThreadPool& pool) {
+        step(state.view(), &pool);
+    }
+
+    // Without a pool the narrow phase runs on the calling thread. onRegion, if set, gets
+    // every particle once, in regions that may be handed over before the step is done.
+    void step(BasicParticleView<S> state, ThreadPool* pool = nullptr, const RegionFn& onRegion = {}) {
+        const size_t count = state.size();
+
+        for (size_t i = 0; i < count; i++) {
+            state.vx[i] += state.fx[i];
+            state.vy[i] += state.fy[i];
+            state.fx[i] = S(0);
+            state.fy[i] = S(0);
+            state.x[i] += state.vx[i];
+            state.y[i] += state.vy[i];
+        }
+        applyBoundaries(state);
+
+        correctionX.resize(count);
+        correctionY.resize(count);
+        touching.resize(count);
+        if (config.broadPhase == BroadPhase::Grid && config.gridMode == GridMode::Dense) {
+            stepBands(state, pool, onRegion);
+            return;
+        }
+        if (config.broadPhase == BroadPhase::SweepAndPrune) {
+            sweep.build(state.x, state.y, count, pool);
+            collide(sweep, pool);
+        } else {
+            hashedGrid.build(state.x, state.y, count);
+            collide(hashedGrid, pool);
+        }
+
+        for (size_t i = 0; i < count; i++) finish(state, uint32_t(i));
+        if (onRegion) {
+            if (everyParticle.size() != count) {
+                everyParticle.resize(count);
+                std::iota(everyParticle.begin(), everyParticle.end(), 0u);
+            }
+            onRegion(everyParticle, 0);
+        }
+    }
+
+    [[nodiscard]] const SolverConfig& getConfig() const { return config; }
+
+    // Distinct contacting pairs found by the last step
+    [[nodiscard]] size_t lastContactCount() const { return contactCount; }
+
+    /*
+     * Calls fn(i) for every particle within r of (x, y), visiting only the cells of the
+     * grid built by the last step that overlap the disc, or the sweep slots in range. The grid lags the positions
+     * by up to one step of motion, so the cells searched are grown by one radius and
+     * the distance is tested against the current positions.
+     */
+    template<class Fn>
+    void forEachParticleNear(const BasicParticleArrays<S>& state, S x, S y, S r, Fn&& fn) const {
+        auto visit = [&](auto& grid) {
+            const S reach = r + radius, r2 = r * r;
+            grid.forEachCellSpanIn(grid.cellX(Coord(x - reach)), grid.cellY(Coord(y - reach)), grid.cellX(Coord(x + reach)),
+                                   grid.cellY(Coord(y + reach)), [&](uint32_t begin, uint32_t end) {
+                for (uint32_t s = begin; s < end; s++) {
+                    uint32_t i = grid.slotParticle[s];
+                    if (i >= state.size()) continue;
+                    S dx = state.x[i] - x, dy = state.y[i] - y;
+                    if (dx * dx + dy * dy <= r2) fn(i);
+                }
+            });
+        };
+        if (config.broadPhase == BroadPhase::SweepAndPrune) {
+            const S r2 = r * r;
+            sweep.forEachSpanNear(x, y, r + radius, [&](uint32_t begin, uint32_t end) {
+                for (uint32_t s = begin; s < end; s++) {
+                    uint32_t i = sweep.slotParticle[s];
+                    if (i >= state.size()) continue;
+                    S dx = state.x[i] - x, dy = state.y[i] - y;
+                    if (dx * dx + dy * dy <= r2) fn(i);
+                }
+            });
+        } else if (config.gridMode == GridMode::Dense) {
+            visit(denseGrid);
+        } else {
+            visit(hashedGrid);
+        }
+    }
+
+private:
+    // The contacts of one run of pair units and the move of each, slot a by +move and slot b by -move
+    struct RunContacts {
+        ContactBuffer pairs;
+        std::vector<S> moveX, moveY;
+    };
+
+    /*
+     * Narrow phase over the slots of the broad phase built this step, in two passes so
+     * the arithmetic runs in full registers:
+     *  -> pair generation: workers take runs of PAIR_GRAIN home cells (skipping empty
+     *     ones) or sweep slots, test every candidate pair once and append the contacts
+     *     to the run's own buffer
+     *  -> resolution: each run's contacts are resolved in SIMD batches into a move per
+     *     contact, no atomics
+     *  -> the moves are added to the particles (ghost images included) run by run, in
+     *     order. Runs are fixed by the unit count rather than by who claimed them, so the
+     *     sums come out the same for any thread count, backend or schedule.
+     */
+    template<class Broad>
+    void collide(const Broad& broad, ThreadPool* pool) {
+        const size_t units = pairUnits(broad);
+        const size_t runs = (units + PAIR_GRAIN - 1) / PAIR_GRAIN;
+        if (runContacts.size() < runs) runContacts.resize(runs);
+
+        // A call may cover several runs when the loop does not split the range
+        auto generate = [&](size_t begin, size_t end, unsigned) {
+            for (size_t first = begin; first < end; first += PAIR_GRAIN) {
+                generateRun(broad, uint32_t(first), uint32_t(std::min(first + PAIR_GRAIN, end)),
+                            runContacts[first / PAIR_GRAIN]);
+            }
+        };
+        auto resolve = [&](size_t begin, size_t end, unsigned) {
+            for (size_t r = begin; r < end; r++) resolveRun(broad, runContacts[r]);
+        };
+        if (pool) {
+            pool->parallelFor(0, units, PAIR_GRAIN, generate);
+            pool->parallelFor(0, runs, 1, resolve);
+        } else {
+            generate(0, units, 0);
+            resolve(0, runs, 0);
+        }
+
+        contactCount = 0;
+        for (size_t r = 0; r < runs; r++) foldRun(broad, runContacts[r]);
+    }
+
+    /*
+     * The dense grid step as a task graph over bands of whole home rows, PAIR_GRAIN
+     * cells or more each, instead of a barrier after every pass:
+     *  -> bin(b): the band's rows of the grid laid out and filled with positions
+     *     (band 0 and the last band also take ghost rows 0 and cellsY + 1)
+     *  -> generate(b): its pairs, after bin(b) and bin(b + 1), whose first row the
+     *     band's last row pairs with
+     *  -> resolve(b) after generate(b)
+     *  -> fold(b) after resolve(b) and fold(b - 1): the runs still fold in order
+     *  -> finish(b): corrections, velocities and boundaries of the band's particles,
+     *     then onRegion for each of its rows. Particles of band b only pair with
+     *     bands b - 1 and b, so after fold(b), except band 0 on a periodic y axis,
+     *     whose ghost row is paired by the last band.
+     * The bands are fixed by the grid, so the sums are the ones collide() gets.
+     */
+    void stepBands(BasicParticleView<S> state, ThreadPool* pool, const RegionFn& onRegion) {
+        BasicUniformGrid<S>& grid = denseGrid;
+        grid.bin(state.x, state.y, state.size());
+        const auto rowsPerBand = uint32_t(std::max<size_t>(1, PAIR_GRAIN / size_t(grid.cellsX)));
+        const uint32_t bands = (uint32_t(grid.cellsY) + rowsPerBand - 1) / rowsPerBand;
+        if (runContacts.size() < bands) runContacts.resize(bands);
+        if (bandScratch.size() < bands) bandScratch.resize(bands);
+        bandStep = {state, &onRegion, rowsPerBand, bands};
+        contactCount = 0;
+
+        if (!pool) {
+            for (uint32_t b = 0; b < bands; b++) binBand(b);
+            for (uint32_t b = 0; b < bands; b++) {
+                generateBand(b);
+                resolveRun(grid, runContacts[b]);
+                foldRun(grid, runContacts[b]);
+            }
+            for (uint32_t b = 0; b < bands; b++) finishBand(b, 0);
+            return;
+        }
+
+        TaskGraph graph;
+        std::vector<TaskGraph::Task> bin(bands), generate(bands), fold(bands), finish(bands);
+        for (uint32_t b = 0; b < bands; b++) {
+            bin[b] = graph.add([this, b](unsigned) { binBand(b); });
+            generate[b] = graph.add([this, b](unsigned) { generateBand(b); });
+            const TaskGraph::Task resolve = graph.add([this, b](unsigned) { resolveRun(denseGrid, runContacts[b]); });
+            fold[b] = graph.add([this, b](unsigned) { foldRun(denseGrid, runContacts[b]); });
+            finish[b] = graph.add([this, b](unsigned worker) { finishBand(b, worker); });
+            graph.precede(bin[b], generate[b]);
+            graph.precede(generate[b], resolve);
+            graph.precede(resolve, fold[b]);
+            graph.precede(fold[b], finish[b]);
+        }
+        for (uint32_t b = 0; b + 1 < bands; b++) {
+            graph.precede(bin[b + 1], generate[b]);
+            graph.precede(fold[b], fold[b + 1]);
+        }
+        if (config.boundaryY == BoundaryMode::Periodic && bands > 1) graph.precede(fold[bands - 1], finish[0]);
+        graph.run(*pool);
+    }
+
+    // Storage rows of band b: its home rows, and the ghost row next to them at either end of the grid
+    [[nodiscard]] std::pair<uint32_t, uint32_t> bandRows(uint32_t b) const {
+        const auto homeRows = uint32_t(denseGrid.cellsY);
+        const uint32_t begin = 1 + b * bandStep.rowsPerBand;
+        const uint32_t end = 1 + std::min(homeRows, (b + 1) * bandStep.rowsPerBand);
+        return {b == 0 ? 0 : begin, b + 1 == bandStep.bands ? homeRows + 2 : end};
+    }
+
+    void binBand(uint32_t b) {
+        auto [begin, end] = bandRows(b);
+        denseGrid.binRows(bandStep.state.x, bandStep.state.y, begin, end, bandScratch[b]);
+    }
+
+    void generateBand(uint32_t b) {
+        const auto cellsX = uint32_t(denseGrid.cellsX), cellsY = uint32_t(denseGrid.cellsY);
+        const uint32_t first = b * bandStep.rowsPerBand;
+        const uint32_t last = std::min(cellsY, first + bandStep.rowsPerBand);
+        generateRun(denseGrid, first * cellsX, last * cellsX, runContacts[b]);
+    }
+
+    void finishBand(uint32_t b, unsigned worker) {
+        const BasicUniformGrid<S>& grid = denseGrid;
+        const auto cellsY = uint32_t(grid.cellsY);
+        const uint32_t first = 1 + b * bandStep.rowsPerBand;
+        const uint32_t last = 1 + std::min(cellsY, (b + 1) * bandStep.rowsPerBand);
+        for (uint32_t row = first; row < last; row++) {
+            const uint32_t begin = grid.cellStart[row * grid.stride + 1];
+            const uint32_t end = grid.cellStart[row * grid.stride + grid.cellsX + 1];
+            for (uint32_t s = begin; s < end; s++) finish(bandStep.state, grid.slotParticle[s]);
+            if (*bandStep.onRegion && begin < end) {
+                (*bandStep.onRegion)(std::span(grid.slotParticle).subspan(begin, end - begin), worker);
+            }
+        }
+    }
+
+    // Contacts of pair units [first, last) into run
+    template<class Broad>
+    void generateRun(const Broad& broad, uint32_t first, uint32_t last, RunContacts& run) const {
+        const BasicAxisImage<S> ix = axisImage(config.boundaryX, width);
+        const BasicAxisImage<S> iy = axisImage(config.boundaryY, height);
+        const S* sx = broad.slotX.data();
+        const S* sy = broad.slotY.data();
+        run.pairs.clear();
+        forEachPairSpan(broad, first, last, [&](uint32_t a, uint32_t b, uint32_t e) {
+            findContacts(a, sx, sy, b, e, radius, ix, iy, run.pairs);
+        });
+    }
+
+    template<class Broad>
+    void resolveRun(const Broad& broad, RunContacts& run) const {
+        const BasicAxisImage<S> ix = axisImage(config.boundaryX, width);
+        const BasicAxisImage<S> iy = axisImage(config.boundaryY, height);
+        run.moveX.resize(run.pairs.size());
+        run.moveY.resize(run.pairs.size());
+        resolveContacts(run.pairs, 0, run.pairs.size(), broad.slotX.data(), broad.slotY.data(), radius, ix, iy,
+                        run.moveX.data(), run.moveY.data());
+    }
+
+    template<class Broad>
+    void foldRun(const Broad& broad, const RunContacts& run) {
+        for (size_t k = 0; k < run.pairs.size(); k++) {
+            const uint32_t a = broad.slotParticle[run.pairs.a[k]];
+            const uint32_t b = broad.slotParticle[run.pairs.b[k]];
+            correctionX[a] += run.moveX[k];
+            correctionY[a] += run.moveY[k];
+            correctionX[b] -= run.moveX[k];
+            correctionY[b] -= run.moveY[k];
+            touching[a] = 1;
+            touching[b] = 1;
+        }
+        contactCount += run.pairs.size();
+    }
+
+    // Applies particle i's correction and clears it for the next step, which relies on that
+    void finish(BasicParticleView<S> state, uint32_t i) {
+        state.x[i] += correctionX[i];
+        state.y[i] += correctionY[i];
+        if (touching[i]) {
+            state.vx[i] = S(0);
+            state.vy[i] = S(0);
+        }
+        correctionX[i] = S(0);
+        correctionY[i] = S(0);
+        touching[i] = 0;
+        applyAxis(config.boundaryX, width, state.x[i], state.vx[i]);
+        applyAxis(config.boundaryY, height, state.y[i], state.vy[i]);
+    }
+
+    // Work units of the pair generation: home cells for the grids, slots for the sweep
+    template<class Grid>
+    static uint32_t pairUnits(const Grid& grid) { return grid.homeCellCount(); }
+    static uint32_t pairUnits(const BasicSweepAndPrune<S>& sweep) { return sweep.pairUnitCount(); }
+
+    // Half shell over the grids: the pairs inside each occupied cell and with its forward neighbours
+    template<class Grid, class Fn>
+    static void forEachPairSpan(const Grid& grid, uint32_t first, uint32_t last, Fn&& fn) {
+        grid.forEachOccupiedCell(first, last, [&](uint32_t cell) {
+            const uint32_t cellEnd = grid.cellStart[cell + 1];
+            for (uint32_t a = grid.cellStart[cell]; a < cellEnd; a++) {
+                fn(a, a + 1, cellEnd);
+                grid.forEachForwardSpan(cell, [&](uint32_t b, uint32_t e) { fn(a, b, e); });
+            }
+        });
+    }
+
+    template<class Fn>
+    static void forEachPairSpan(const BasicSweepAndPrune<S>& sweep, uint32_t first, uint32_t last, Fn&& fn) {
+        sweep.forEachPairSpan(first, last, fn);
+    }
+
+    static BasicAxisImage<S> axisImage(BoundaryMode mode, S extent) {
+        if (mode == BoundaryMode::Periodic) return {extent, S(1) / extent};
+        return {};
+    }
+
+    static void applyAxis(BoundaryMode mode, S extent, S& p, S& v) {
+        if (mode == BoundaryMode::Periodic) {
+            p = wrapPeriodic(p, extent);
+        } else if (mode == BoundaryMode::Open) {
+            return;
+        } else if (p < S(0)) {
+            p = S(0);
+            v = -v;
+        } else if (p > extent) {
+            p = extent;
+            v = -v;
+        }
+    }
+
+    void applyBoundaries(BasicParticleView<S> state) const {
+        for (size_t i = 0; i < state.size(); i++) {
+            applyAxis(config.boundaryX, width, state.x[i], state.vx[i]);
+            applyAxis(config.boundaryY, height, state.y[i], state.vy[i]);
+        }
+    }
+
+    // What the band tasks of this step work on
+    struct BandStep {
+        BasicParticleView<S> state;
+        const RegionFn* onRegion{};
+        uint32_t rowsPerBand{}, bands{};
+    };
+
+    // Home cells, or sweep slots, per pair generation task and per run of contacts
+    static constexpr size_t PAIR_GRAIN = 4096;
+
+    SolverConfig config;
+    S width{}, height{}, radius{};
+    BasicUniformGrid<S> denseGrid;
+    BasicHashedGrid<S> hashedGrid;
+    BasicSweepAndPrune<S> sweep;
+    std::vector<S> correctionX, correctionY;
+    std::vector<uint8_t> touching;
+    std::vector<RunContacts> runContacts;
+    size_t contactCount{};
+    std::vector<uint32_t> everyParticle;
+
+    BandStep bandStep;
+    std::vector<std::vector<uint32_t>> bandScratch;
+};
+
+using CollisionSolver = BasicCollisionSolver<float>;
+
+#endif //OPERATINGSYSTEMSCLASS_COLLISIONSOLVER_H
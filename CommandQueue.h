@@ -0,0 +1,146 @@
+#ifndef OPERATINGSYSTEMSCLASS_COMMANDQUEUE_H
+#define OPERATINGSYSTEMSCLASS_COMMANDQUEUE_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <vector>
+#include "CollisionSolver.h"
+#include "InteractionTools.h"
+
+enum class SolverParameter : uint32_t {
+    Radius = 1,
+    BoundaryX = 2, // value is a BoundaryMode
+    BoundaryY = 3,
+    Grid = 4,      // value is a GridMode
+    Broad = 5,     // value is a BroadPhase
+};
+
+inline bool applyParameter(SolverConfig& config, SolverParameter parameter, float value) {
+    switch (parameter) {
+        case SolverParameter::Radius:
+            if (!(value > 0.0f)) return false;
+            config.radius = value;
+            return true;
+        case SolverParameter::BoundaryX:
+        case SolverParameter::BoundaryY: {
+            int mode = int(value);
+            if (mode < 0 || mode > int(BoundaryMode::Open)) return false;
+            (parameter == SolverParameter::BoundaryX ? config.boundaryX : config.boundaryY) = BoundaryMode(mode);
+            return true;
+        }
+        case SolverParameter::Grid: {
+            int mode = int(value);
+            if (mode < 0 || mode > int(GridMode::Hashed)) return false;
+            config.gridMode = GridMode(mode);
+            return true;
+        }
+        case SolverParameter::Broad: {
+            int mode = int(value);
+            if (mode < 0 || mode > int(BroadPhase::SweepAndPrune)) return false;
+            config.broadPhase = BroadPhase(mode);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Everything outside the simulation loop may ask for, applied only between steps
+struct Command {
+    enum class Type : uint16_t {
+        Pause,
+        Resume,
+        Step,         // steps while paused
+        SetParameter, // changes one SolverConfig field
+        Spawn,        // adds particles
+        Tool,         // applies one frame of a mouse tool
+    };
+
+    Type type{};
+    uint32_t steps{};
+    SolverParameter parameter{};
+    float value{};
+    ParticleArrays particles{};
+    ToolAction tool{};
+};
+
+/*
+ * Producers (the control server, input callbacks) append under a mutex; the
+ * simulation swaps the whole pending vector out once per step, so it never waits
+ * longer than one push_back and never runs a command in the middle of a step.
+ */
+class CommandQueue {
+public:
+    void push(Command command) {
+        std::lock_guard lock(mutex);
+        pending.push_back(std::move(command));
+    }
+
+    void pushBatch(std::vector<Command>& commands) {
+        if (commands.empty()) return;
+        std::lock_guard lock(mutex);
+        for (auto& command : commands) pending.push_back(std::move(command));
+        commands.clear();
+    }
+
+    // Swaps the pending commands into out, which is cleared first and keeps its capacity
+    void drain(std::vector<Command>& out) {
+        out.clear();
+        std::lock_guard lock(mutex);
+        pending.swap(out);
+    }
+
+private:
+    std::mutex mutex;
+    std::vector<Command> pending;
+};
+
+struct SimulationStats {
+    uint64_t frame;
+    uint32_t particleCount;
+    uint32_t paused;
+    float stepMilliseconds;
+    float radius;
+    uint32_t contacts; // contacting pairs in the last step
+};
+
+// Single writer seqlock for the latest statistics, so queries never block a step
+class StatsBoard {
+public:
+    void store(const SimulationStats& value) {
+        uint64_t s = sequence.load(std::memory_order_relaxed);
+        sequence.store(s + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (size_t w = 0; w < WORDS; w++) {
+            uint32_t word;
+            std::memcpy(&word, reinterpret_cast<const uint8_t*>(&value) + w * 4, 4);
+            words[w].store(word, std::memory_order_relaxed);
+        }
+        sequence.store(s + 2, std::memory_order_release);
+    }
+
+    [[nodiscard]] SimulationStats load() const {
+        SimulationStats value{};
+        uint64_t before, after;
+        do {
+            before = sequence.load(std::memory_order_acquire);
+            for (size_t w = 0; w < WORDS; w++) {
+                uint32_t word = words[w].load(std::memory_order_relaxed);
+                std::memcpy(reinterpret_cast<uint8_t*>(&value) + w * 4, &word, 4);
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            after = sequence.load(std::memory_order_relaxed);
+        } while (before != after || (before & 1));
+        return value;
+    }
+
+private:
+    static_assert(sizeof(SimulationStats) % 4 == 0);
+    static constexpr size_t WORDS = sizeof(SimulationStats) / 4;
+
+    std::atomic<uint64_t> sequence{0};
+    std::atomic<uint32_t> words[WORDS]{};
+};
+
+#endif //OPERATINGSYSTEMSCLASS_COMMANDQUEUE_H
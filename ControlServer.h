@@ -0,0 +1,322 @@
+#ifndef OPERATINGSYSTEMSCLASS_CONTROLSERVER_H
+#define OPERATINGSYSTEMSCLASS_CONTROLSERVER_H
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "CommandQueue.h"
+
+/*
+ * Binary protocol spoken over the control socket. Every message, request or
+ * response, is a 12 byte little endian header followed by payloadBytes of payload:
+ *
+ *  Pause, Resume          no payload
+ *  Step                   uint32 steps, only runs while paused
+ *  SetParameter           uint32 SolverParameter, float value
+ *  Spawn                  uint32 count, count x (float x, y, vx, vy), refused past
+ *                         the server's particle limit
+ *  QueryStats             no payload, answered with a SimulationStats
+ *
+ * Responses echo opcode and requestId. Commands are answered with Queued once they
+ * are in the CommandQueue; they take effect at the next step boundary.
+ */
+struct ControlProtocol {
+    enum Opcode : uint16_t {
+        Pause = 1,
+        Resume = 2,
+        Step = 3,
+        SetParameter = 4,
+        Spawn = 5,
+        QueryStats = 6,
+    };
+
+    enum Status : uint16_t {
+        Ok = 0,
+        Queued = 1,
+        BadRequest = 2,
+        UnknownOpcode = 3,
+    };
+
+    struct Header {
+        uint16_t opcode;
+        uint16_t status;
+        uint32_t requestId;
+        uint32_t payloadBytes;
+    };
+    static_assert(sizeof(Header) == 12);
+
+    static constexpr uint32_t MAX_PAYLOAD = 16u << 20;
+};
+
+/*
+ * epoll driven I/O thread serving the control socket:
+ *  -> wait for readiness on the listening socket, the clients and a wake eventfd
+ *  -> read every ready client until EAGAIN and parse all complete requests
+ *  -> hand every command of the wakeup to the CommandQueue in one locked push
+ *  -> write all responses of a client at once, waiting for EPOLLOUT if needed
+ *
+ * The simulation thread only ever touches the CommandQueue and the StatsBoard,
+ * so control traffic cannot delay a step.
+ */
+class ControlServer {
+public:
+    ControlServer(std::string socketPath, CommandQueue& commands, const StatsBoard& stats, uint32_t maxParticles)
+            : socketPath(std::move(socketPath)), commands(commands), stats(stats), maxParticles(maxParticles) {
+        listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (listenFd < 0) fail("SOCKET_FAILED");
+
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        if (this->socketPath.size() >= sizeof(address.sun_path)) {
+            errno = ENAMETOOLONG;
+            fail("BIND_FAILED");
+        }
+        std::strcpy(address.sun_path, this->socketPath.c_str());
+        unlink(this->socketPath.c_str());
+        if (bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) fail("BIND_FAILED");
+        if (listen(listenFd, 16) != 0) fail("LISTEN_FAILED");
+
+        epollFd = epoll_create1(EPOLL_CLOEXEC);
+        wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (epollFd < 0 || wakeFd < 0) fail("EPOLL_FAILED");
+        watch(listenFd, EPOLLIN, EPOLL_CTL_ADD);
+        watch(wakeFd, EPOLLIN, EPOLL_CTL_ADD);
+
+        thread = std::thread([this] { run(); });
+    }
+
+    ~ControlServer() {
+        uint64_t one = 1;
+        if (write(wakeFd, &one, sizeof(one)) < 0) {
+            std::cout << "ERROR::CONTROLSERVER::WAKE_FAILED\n" << std::strerror(errno) << std::endl;
+        }
+        thread.join();
+        for (auto& [fd, client] : clients) close(fd);
+        close(listenFd);
+        close(epollFd);
+        close(wakeFd);
+        unlink(socketPath.c_str());
+    }
+
+    ControlServer(const ControlServer&) = delete;
+    ControlServer& operator=(const ControlServer&) = delete;
+
+private:
+    struct Client {
+        std::vector<uint8_t> in, out;
+        uint32_t watching = EPOLLIN;
+        // The client shut its side down: answer what it sent, then disconnect
+        bool halfClosed = false;
+    };
+
+    static void fail(const char* what) {
+        std::cout << "ERROR::CONTROLSERVER::" << what << "\n" << std::strerror(errno) << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    void watch(int fd, uint32_t events, int operation) const {
+        epoll_event event{};
+        event.events = events;
+        event.data.fd = fd;
+        epoll_ctl(epollFd, operation, fd, &event);
+    }
+
+    void run() {
+        epoll_event events[64];
+        std::vector<int> touched;
+        while (true) {
+            int ready = epoll_wait(epollFd, events, 64, -1);
+            if (ready < 0) {
+                if (errno == EINTR) continue;
+                fail("EPOLL_WAIT_FAILED");
+            }
+
+            touched.clear();
+            for (int e = 0; e < ready; e++) {
+                int fd = events[e].data.fd;
+                if (fd == wakeFd) return;
+                if (fd == listenFd) {
+                    acceptAll();
+                    continue;
+                }
+                auto it = clients.find(fd);
+                if (it == clients.end()) continue;
+                if (events[e].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                    if (!receive(fd, it->second)) {
+                        disconnect(fd);
+                        continue;
+                    }
+                }
+                touched.push_back(fd);
+            }
+
+            // One lock for every command of this wakeup, before any client sees its ack
+            commands.pushBatch(batch);
+
+            for (int fd : touched) {
+                auto it = clients.find(fd);
+                if (it == clients.end()) continue;
+                if (!send(fd, it->second) || (it->second.halfClosed && it->second.out.empty())) disconnect(fd);
+            }
+        }
+    }
+
+    void acceptAll() {
+        while (true) {
+            int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) return;
+            clients.emplace(fd, Client{});
+            watch(fd, EPOLLIN, EPOLL_CTL_ADD);
+        }
+    }
+
+    void disconnect(int fd) {
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+        close(fd);
+        clients.erase(fd);
+    }
+
+    // Reads until EAGAIN or end of file and handles every complete request; false closes the client
+    bool receive(int fd, Client& client) {
+        uint8_t buffer[64 * 1024];
+        while (true) {
+            ssize_t n = read(fd, buffer, sizeof(buffer));
+            if (n > 0) {
+                client.in.insert(client.in.end(), buffer, buffer + n);
+                continue;
+            }
+            if (n == 0) {
+                client.halfClosed = true;
+                break;
+            }
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            return false;
+        }
+
+        size_t offset = 0;
+        while (client.in.size() - offset >= sizeof(ControlProtocol::Header)) {
+            ControlProtocol::Header header{};
+            std::memcpy(&header, client.in.data() + offset, sizeof(header));
+            if (header.payloadBytes > ControlProtocol::MAX_PAYLOAD) return false;
+            if (client.in.size() - offset - sizeof(header) < header.payloadBytes) break;
+            handle(client, header, client.in.data() + offset + sizeof(header));
+            offset += sizeof(header) + header.payloadBytes;
+        }
+        client.in.erase(client.in.begin(), client.in.begin() + long(offset));
+        return true;
+    }
+
+    void handle(Client& client, const ControlProtocol::Header& request, const uint8_t* payload) {
+        auto reply = [&](uint16_t status, const void* data = nullptr, uint32_t bytes = 0) {
+            ControlProtocol::Header response{request.opcode, status, request.requestId, bytes};
+            auto* raw = reinterpret_cast<const uint8_t*>(&response);
+            client.out.insert(client.out.end(), raw, raw + sizeof(response));
+            if (bytes) client.out.insert(client.out.end(), (const uint8_t*) data, (const uint8_t*) data + bytes);
+        };
+        auto queue = [&](Command command) {
+            batch.push_back(std::move(command));
+            reply(ControlProtocol::Queued);
+        };
+
+        switch (request.opcode) {
+            case ControlProtocol::Pause:
+                queue({Command::Type::Pause});
+                return;
+            case ControlProtocol::Resume:
+                queue({Command::Type::Resume});
+                return;
+            case ControlProtocol::Step: {
+                if (request.payloadBytes != 4) break;
+                Command command{Command::Type::Step};
+                std::memcpy(&command.steps, payload, 4);
+                queue(std::move(command));
+                return;
+            }
+            case ControlProtocol::SetParameter: {
+                if (request.payloadBytes != 8) break;
+                Command command{Command::Type::SetParameter};
+                std::memcpy(&command.parameter, payload, 4);
+                std::memcpy(&command.value, payload + 4, 4);
+                SolverConfig check{1.0f, 1.0f, 1.0f};
+                if (!applyParameter(check, command.parameter, command.value)) break;
+                queue(std::move(command));
+                return;
+            }
+            case ControlProtocol::Spawn: {
+                uint32_t count;
+                if (request.payloadBytes < 4) break;
+                std::memcpy(&count, payload, 4);
+                if (request.payloadBytes != 4 + uint64_t(count) * 16) break;
+                // Against the last published count; the simulation checks again when it applies the spawn
+                if (uint64_t(stats.load().particleCount) + count > maxParticles) break;
+                Command command{Command::Type::Spawn};
+                command.particles.resize(count);
+                const uint8_t* p = payload + 4;
+                for (uint32_t i = 0; i < count; i++, p += 16) {
+                    std::memcpy(&command.particles.x[i], p, 4);
+                    std::memcpy(&command.particles.y[i], p + 4, 4);
+                    std::memcpy(&command.particles.vx[i], p + 8, 4);
+                    std::memcpy(&command.particles.vy[i], p + 12, 4);
+                }
+                queue(std::move(command));
+                return;
+            }
+            case ControlProtocol::QueryStats: {
+                SimulationStats current = stats.load();
+                reply(ControlProtocol::Ok, &current, sizeof(current));
+                return;
+            }
+            default:
+                reply(ControlProtocol::UnknownOpcode);
+                return;
+        }
+        reply(ControlProtocol::BadRequest);
+    }
+
+    // Writes as much as the socket takes, the rest waits for EPOLLOUT; a half closed client
+    // has nothing more to read, so only its output is watched
+    bool send(int fd, Client& client) {
+        size_t offset = 0;
+        while (offset < client.out.size()) {
+            ssize_t n = write(fd, client.out.data() + offset, client.out.size() - offset);
+            if (n > 0) {
+                offset += size_t(n);
+                continue;
+            }
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+            return false;
+        }
+        client.out.erase(client.out.begin(), client.out.begin() + long(offset));
+
+        const uint32_t events = (client.halfClosed ? 0u : uint32_t(EPOLLIN)) | (client.out.empty() ? 0u : uint32_t(EPOLLOUT));
+        if (events != client.watching) {
+            watch(fd, events, EPOLL_CTL_MOD);
+            client.watching = events;
+        }
+        return true;
+    }
+
+    std::string socketPath;
+    CommandQueue& commands;
+    const StatsBoard& stats;
+    uint32_t maxParticles;
+
+    int listenFd = -1, epollFd = -1, wakeFd = -1;
+    std::thread thread;
+    std::unordered_map<int, Client> clients;
+    std::vector<Command> batch;
+};
+
+#endif //OPERATINGSYSTEMSCLASS_CONTROLSERVER_H
@@ -0,0 +1,135 @@
+#ifndef OPERATINGSYSTEMSCLASS_ENSEMBLE_H
+#define OPERATINGSYSTEMSCLASS_ENSEMBLE_H
+
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <vector>
+#include "CollisionSolver.h"
+#include "ParticleArrays.h"
+#include "ThreadPool.h"
+
+// One run of a sweep: the solver setup plus how createPoints should lay out its particles
+struct EnsembleScene {
+    SolverConfig config;
+    uint32_t count = 512;
+    float spacing = 1.2f; // between neighbours, in radii
+    float vx = 0.0f, vy = -1.0f;
+};
+
+struct SceneResult {
+    uint64_t steps{};
+    float meanX{}, meanY{};
+    float meanSpeed{};
+    float kineticEnergy{}; // unit mass
+    float minY{}, maxY{};
+};
+
+/*
+ * Many small independent scenes stepped together in one process:
+ *  -> every scene's particles live in one shared set of SoA arrays, back to back
+ *  -> a step hands whole scenes to the pool, each worker reusing its own solver
+ *  -> a scene runs all its steps in one task, so its few KB stay in the worker's cache
+ *
+ * Scenes never interact, so the results do not depend on the thread count.
+ */
+class Ensemble {
+public:
+    uint32_t addScene(const EnsembleScene& scene) {
+        Range range{state.size(), scene.count, scene.config};
+        const float step = scene.config.radius * scene.spacing;
+        const float left = 3 * scene.config.width / 8, right = 5 * scene.config.width / 8;
+        float x = left, y = 100;
+        for (uint32_t i = 0; i < scene.count; i++) {
+            state.push(x, y, scene.vx, scene.vy);
+            x += step;
+            if (x > right) {
+                y += step;
+                x = left;
+            }
+        }
+        scenes.push_back(range);
+        stepped.push_back(0);
+        return uint32_t(scenes.size() - 1);
+    }
+
+    [[nodiscard]] size_t sceneCount() const { return scenes.size(); }
+    [[nodiscard]] size_t particleCount() const { return state.size(); }
+
+    [[nodiscard]] ParticleView scene(uint32_t index) {
+        return state.view(scenes[index].begin, scenes[index].count);
+    }
+
+    void step(uint32_t steps, ThreadPool& pool) {
+        if (solvers.size() < pool.size()) {
+            solvers.resize(pool.size(), CollisionSolver(scenes.empty() ? SolverConfig{1, 1, 1} : scenes[0].config));
+        }
+        pool.parallelFor(0, scenes.size(), 1, [&](size_t begin, size_t end, unsigned worker) {
+            CollisionSolver& solver = solvers[worker];
+            for (size_t s = begin; s < end; s++) {
+                solver.setConfig(scenes[s].config);
+                ParticleView view = state.view(scenes[s].begin, scenes[s].count);
+                for (uint32_t k = 0; k < steps; k++) solver.step(view);
+                stepped[s] += steps;
+            }
+        });
+    }
+
+    [[nodiscard]] SceneResult result(uint32_t index) const {
+        const Range& range = scenes[index];
+        SceneResult r{stepped[index]};
+        if (range.count == 0) return r;
+
+        r.minY = r.maxY = state.y[range.begin];
+        double sumX = 0, sumY = 0, sumSpeed = 0, energy = 0;
+        for (size_t i = range.begin; i < range.begin + range.count; i++) {
+            double v2 = double(state.vx[i]) * state.vx[i] + double(state.vy[i]) * state.vy[i];
+            sumX += state.x[i];
+            sumY += state.y[i];
+            sumSpeed += std::sqrt(v2);
+            energy += 0.5 * v2;
+            r.minY = std::min(r.minY, state.y[i]);
+            r.maxY = std::max(r.maxY, state.y[i]);
+        }
+        r.meanX = float(sumX / range.count);
+        r.meanY = float(sumY / range.count);
+        r.meanSpeed = float(sumSpeed / range.count);
+        r.kineticEnergy = float(energy);
+        return r;
+    }
+
+    // One CSV row per scene, with the parameters that produced it
+    void writeResults(const char* path, const std::vector<EnsembleScene>& specs) const {
+        FILE* file = std::fopen(path, "w");
+        if (!file) {
+            std::cout << "ERROR::ENSEMBLE::OPEN_FAILED\n" << std::strerror(errno) << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        std::fprintf(file, "scene,radius,spacing,vx,vy,count,steps,mean_x,mean_y,mean_speed,kinetic_energy,min_y,max_y\n");
+        for (uint32_t s = 0; s < scenes.size(); s++) {
+            const EnsembleScene& spec = specs[s];
+            SceneResult r = result(s);
+            std::fprintf(file, "%u,%g,%g,%g,%g,%u,%llu,%g,%g,%g,%g,%g,%g\n", s, spec.config.radius, spec.spacing,
+                         spec.vx, spec.vy, spec.count, (unsigned long long) r.steps, r.meanX, r.meanY,
+                         r.meanSpeed, r.kineticEnergy, r.minY, r.maxY);
+        }
+        std::fclose(file);
+    }
+
+private:
+    struct Range {
+        size_t begin;
+        uint32_t count;
+        SolverConfig config;
+    };
+
+    ParticleArrays state;
+    std::vector<Range> scenes;
+    std::vector<uint64_t> stepped;
+    std::vector<CollisionSolver> solvers;
+};
+
+#endif //OPERATINGSYSTEMSCLASS_ENSEMBLE_H
@@ -0,0 +1,168 @@
+#ifndef OPERATINGSYSTEMSCLASS_FORCEFIELDS_H
+#define OPERATINGSYSTEMSCLASS_FORCEFIELDS_H
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <utility>
+#include <vector>
+#include "CollisionSolver.h"
+#include "ParticleArrays.h"
+#include "ThreadPool.h"
+
+enum class FieldKind : uint8_t {
+    Gravity, // constant acceleration (x, y)
+    Wind,    // pulls the velocity towards (x, y) at rate strength
+    Vortex,  // swirl around (x, y), strongest at the centre, zero past radius
+};
+
+struct ForceField {
+    FieldKind kind{};
+    float x{}, y{};
+    float strength{};
+    float radius{};
+};
+
+// Vector field sampled on a regular grid of width x height samples, cellSize apart,
+// with sample (0, 0) at (originX, originY). Positions outside are clamped to the edge.
+// ForceStage::add refuses textures without samples or whose u and v do not fill the grid.
+struct FlowTexture {
+    uint32_t width{}, height{};
+    float originX{}, originY{};
+    float cellSize = 1.0f;
+    float strength = 1.0f;
+    std::vector<float> u, v; // row-major, width * height each
+};
+
+/*
+ * Force stage run before the solver's step. Every field and texture is evaluated for
+ * a register of particles before moving to the next one:
+ *  -> load x, y, vx, vy, fx, fy once
+ *  -> add each field's contribution in registers
+ *  -> store fx, fy once
+ * so the memory traffic stays one pass no matter how many fields are active.
+ */
+class ForceStage {
+public:
+    // False, with the reason printed, for a vortex of radius 0, which would divide by it
+    bool add(const ForceField& field) {
+        if (field.kind == FieldKind::Vortex && !(field.radius > 0.0f)) {
+            std::cout << "ERROR::FORCESTAGE::BAD_VORTEX_RADIUS\n" << field.radius << std::endl;
+            return false;
+        }
+        fields.push_back(field);
+        return true;
+    }
+
+    // False, with the reason printed, for a texture sample() would read out of bounds
+    bool add(FlowTexture texture) {
+        const size_t samples = size_t(texture.width) * texture.height;
+        if (samples == 0 || texture.u.size() != samples || texture.v.size() != samples || !(texture.cellSize > 0.0f)) {
+            std::cout << "ERROR::FORCESTAGE::BAD_TEXTURE\n" << texture.width << "x" << texture.height << " samples, "
+                      << texture.u.size() << " u and " << texture.v.size() << " v values, cell size "
+                      << texture.cellSize << std::endl;
+            return false;
+        }
+        textures.push_back(std::move(texture));
+        return true;
+    }
+
+    [[nodiscard]] bool empty() const { return fields.empty() && textures.empty(); }
+
+    void apply(ParticleArrays& state, ThreadPool& pool) const {
+        if (empty()) return;
+        pool.parallelFor(0, state.size(), GRAIN, [&](size_t begin, size_t end, unsigned) {
+            applyRange(state, begin, end);
+        });
+    }
+
+    // On the calling thread, for callers already running inside a parallel loop
+    void apply(ParticleArrays& state) const {
+        if (!empty()) applyRange(state, 0, state.size());
+    }
+
+private:
+    std::vector<ForceField> fields;
+    std::vector<FlowTexture> textures;
+
+    // A multiple of the register width, so only the last chunk has a partial register
+    static constexpr size_t GRAIN = 64 * floatv::size();
+
+    void applyRange(ParticleArrays& state, size_t begin, size_t end) const {
+        constexpr size_t W = floatv::size();
+        size_t i = begin;
+        for (; i + W <= end; i += W) {
+            floatv x(&state.x[i], stdx::element_aligned), y(&state.y[i], stdx::element_aligned);
+            floatv vx(&state.vx[i], stdx::element_aligned), vy(&state.vy[i], stdx::element_aligned);
+            floatv fx(&state.fx[i], stdx::element_aligned), fy(&state.fy[i], stdx::element_aligned);
+            accumulate(x, y, vx, vy, fx, fy);
+            fx.copy_to(&state.fx[i], stdx::element_aligned);
+            fy.copy_to(&state.fy[i], stdx::element_aligned);
+        }
+        if (i == end) return;
+
+        // Tail lanes are evaluated at the origin and dropped on the way out
+        auto load = [&](const std::vector<float>& a) {
+            return floatv([&](auto l) { return i + l < end ? a[i + l] : 0.0f; });
+        };
+        floatv x = load(state.x), y = load(state.y), vx = load(state.vx), vy = load(state.vy);
+        floatv fx = load(state.fx), fy = load(state.fy);
+        accumulate(x, y, vx, vy, fx, fy);
+        for (size_t l = 0; i + l < end; l++) {
+            state.fx[i + l] = fx[l];
+            state.fy[i + l] = fy[l];
+        }
+    }
+
+    void accumulate(floatv x, floatv y, floatv vx, floatv vy, floatv& fx, floatv& fy) const {
+        for (const ForceField& field : fields) {
+            switch (field.kind) {
+                case FieldKind::Gravity:
+                    fx += field.x;
+                    fy += field.y;
+                    break;
+                case FieldKind::Wind:
+                    fx += field.strength * (field.x - vx);
+                    fy += field.strength * (field.y - vy);
+                    break;
+                case FieldKind::Vortex: {
+                    floatv dx = x - field.x, dy = y - field.y;
+                    floatv falloff = stdx::max(floatv(0.0f), 1.0f - (dx * dx + dy * dy) / (field.radius * field.radius));
+                    floatv scale = field.strength / field.radius * falloff;
+                    fx -= dy * scale;
+                    fy += dx * scale;
+                    break;
+                }
+            }
+        }
+        for (const FlowTexture& texture : textures) sample(texture, x, y, fx, fy);
+    }
+
+    // Bilinear sample; there is no gather in std::experimental::simd, so the four taps
+    // are fetched lane by lane and the blend is done in registers
+    static void sample(const FlowTexture& texture, floatv x, floatv y, floatv& fx, floatv& fy) {
+        const float inv = 1.0f / texture.cellSize;
+        const float maxX = float(texture.width - 1), maxY = float(texture.height - 1);
+        floatv gx = stdx::clamp((x - texture.originX) * inv, floatv(0.0f), floatv(maxX));
+        floatv gy = stdx::clamp((y - texture.originY) * inv, floatv(0.0f), floatv(maxY));
+        floatv cx = stdx::floor(gx), cy = stdx::floor(gy);
+        floatv tx = gx - cx, ty = gy - cy;
+
+        auto tap = [&](const std::vector<float>& a, int ox, int oy) {
+            return floatv([&](auto l) {
+                auto sx = std::min(uint32_t(cx[l]) + ox, texture.width - 1);
+                auto sy = std::min(uint32_t(cy[l]) + oy, texture.height - 1);
+                return a[size_t(sy) * texture.width + sx];
+            });
+        };
+        auto blend = [&](const std::vector<float>& a) {
+            floatv bottom = tap(a, 0, 0) + tx * (tap(a, 1, 0) - tap(a, 0, 0));
+            floatv top = tap(a, 0, 1) + tx * (tap(a, 1, 1) - tap(a, 0, 1));
+            return bottom + ty * (top - bottom);
+        };
+        fx += texture.strength * blend(texture.u);
+        fy += texture.strength * blend(texture.v);
+    }
+};
+
+#endif //OPERATINGSYSTEMSCLASS_FORCEFIELDS_H
@@ -0,0 +1,544 @@
+#ifndef OPERATINGSYSTEMSCLASS_FRAMEPIPELINE_H
+#define OPERATINGSYSTEMSCLASS_FRAMEPIPELINE_H
+
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <coroutine>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "IoRing.h"
+
+/*
+ * Pieces for running the frame loop as coroutines:
+ *  -> PipelineTask: a coroutine that starts right away and runs until it first waits;
+ *     co_await on one waits for it to finish
+ *  -> ResumeQueue: coroutines waiting on something are resumed from here, on the
+ *     thread that pumps it (the GL thread in the viewer), whoever woke them up
+ *  -> DepthLimit: at most N of something in flight, the N + 1-th waits
+ *  -> JobThread: work too long for the pumping thread, like a simulation step, runs
+ *     on a thread of its own while the awaiting coroutine is suspended
+ *  -> AsyncWriter: file writes on io_uring or pwrite threads, the writing coroutine is
+ *     suspended instead of a pipeline thread being blocked
+ *
+ * Everything but AsyncWriter's threads and the JobThread's jobs runs on the pumping
+ * thread, so coroutines and the stages they drive need no locking among themselves.
+ */
+class PipelineTask {
+public:
+    struct promise_type;
+    using Handle = std::coroutine_handle<promise_type>;
+
+    // Kept around once done so the owner can see it finished, resumes whoever awaited it
+    struct FinalAwaiter {
+        bool await_ready() const noexcept { return false; }
+        std::coroutine_handle<> await_suspend(Handle handle) noexcept {
+            auto continuation = handle.promise().continuation;
+            return continuation ? continuation : std::noop_coroutine();
+        }
+        void await_resume() const noexcept {}
+    };
+
+    struct promise_type {
+        std::coroutine_handle<> continuation;
+
+        PipelineTask get_return_object() { return PipelineTask(Handle::from_promise(*this)); }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        FinalAwaiter final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+
+    PipelineTask() = default;
+    explicit PipelineTask(Handle handle) : handle(handle) {}
+    PipelineTask(PipelineTask&& other) noexcept : handle(std::exchange(other.handle, {})) {}
+    PipelineTask& operator=(PipelineTask&& other) noexcept {
+        if (this != &other) {
+            if (handle) handle.destroy();
+            handle = std::exchange(other.handle, {});
+        }
+        return *this;
+    }
+    ~PipelineTask() {
+        if (handle) handle.destroy();
+    }
+
+    [[nodiscard]] bool done() const { return !handle || handle.done(); }
+
+    auto operator co_await() const noexcept {
+        struct Awaiter {
+            Handle handle;
+            bool await_ready() const noexcept { return !handle || handle.done(); }
+            void await_suspend(std::coroutine_handle<> waiter) const noexcept { handle.promise().continuation = waiter; }
+            void await_resume() const noexcept {}
+        };
+        return Awaiter{handle};
+    }
+
+private:
+    Handle handle;
+};
+
+class ResumeQueue {
+public:
+    // Any thread
+    void post(std::coroutine_handle<> handle) {
+        {
+            std::lock_guard lock(mutex);
+            posted.push_back(handle);
+        }
+        wake.notify_one();
+    }
+
+    // Resumes what was posted so far, returns whether there was anything
+    bool pump() {
+        {
+            std::lock_guard lock(mutex);
+            running.swap(posted);
+        }
+        for (auto handle : running) handle.resume();
+        bool any = !running.empty();
+        running.clear();
+        return any;
+    }
+
+    // Blocks until something was posted, then pumps
+    void waitAndPump() {
+        {
+            std::unique_lock lock(mutex);
+            wake.wait(lock, [this] { return !posted.empty(); });
+        }
+        pump();
+    }
+
+    // co_await queue.yield(): continue from the next pump
+    auto yield() {
+        struct Awaiter {
+            ResumeQueue& queue;
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(std::coroutine_handle<> handle) { queue.post(handle); }
+            void await_resume() const noexcept {}
+        };
+        return Awaiter{*this};
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::vector<std::coroutine_handle<>> posted, running;
+};
+
+// Counting semaphore for coroutines on the pumping thread
+class DepthLimit {
+public:
+    DepthLimit(ResumeQueue& resumes, uint32_t depth) : resumes(resumes), free(depth) {}
+
+    auto acquire() {
+        struct Awaiter {
+            DepthLimit& limit;
+            bool await_ready() const noexcept {
+                if (limit.free == 0) return false;
+                limit.free--;
+                return true;
+            }
+            void await_suspend(std::coroutine_handle<> handle) { limit.waiting.push_back(handle); }
+            void await_resume() const noexcept {}
+        };
+        return Awaiter{*this};
+    }
+
+    // Hands the place straight to the oldest waiter, which resumes at the next pump
+    void release() {
+        if (waiting.empty()) {
+            free++;
+            return;
+        }
+        resumes.post(waiting.front());
+        waiting.pop_front();
+    }
+
+private:
+    ResumeQueue& resumes;
+    uint32_t free;
+    std::deque<std::coroutine_handle<>> waiting;
+};
+
+// Jobs one after the other on a thread of its own, each awaiting coroutine resumed from the queue once its job returned
+class JobThread {
+public:
+    explicit JobThread(ResumeQueue& resumes) : resumes(resumes), thread([this] { loop(); }) {}
+
+    ~JobThread() {
+        {
+            std::lock_guard lock(mutex);
+            stopping = true;
+        }
+        wake.notify_one();
+        thread.join();
+    }
+
+    JobThread(const JobThread&) = delete;
+    JobThread& operator=(const JobThread&) = delete;
+
+    // co_await jobs.run(fn): whatever fn touches belongs to the job thread until then
+    auto run(std::function<void()> fn) {
+        struct Awaiter {
+            JobThread& jobs;
+            std::function<void()> fn;
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(std::coroutine_handle<> handle) { jobs.submit({std::move(fn), handle}); }
+            void await_resume() const noexcept {}
+        };
+        return Awaiter{*this, std::move(fn)};
+    }
+
+private:
+    struct Job {
+        std::function<void()> fn;
+        std::coroutine_handle<> waiter;
+    };
+
+    void submit(Job job) {
+        {
+            std::lock_guard lock(mutex);
+            jobs.push_back(std::move(job));
+        }
+        wake.notify_one();
+    }
+
+    void loop() {
+        while (true) {
+            Job job;
+            {
+                std::unique_lock lock(mutex);
+                wake.wait(lock, [this] { return stopping || !jobs.empty(); });
+                if (jobs.empty()) return;
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
+            job.fn();
+            resumes.post(job.waiter);
+        }
+    }
+
+    ResumeQueue& resumes;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<Job> jobs;
+    bool stopping = false;
+    std::thread thread;
+};
+
+enum class WriterBackend {
+    Auto,    // io_uring when the kernel has it, Threads otherwise
+    IoUring, // batched submissions on a ring, fixed writes from registered buffers
+    Threads, // pwrite on a few threads of the writer's own
+};
+
+inline const char* writerBackendName(WriterBackend backend) {
+    switch (backend) {
+        case WriterBackend::Auto: return "auto";
+        case WriterBackend::IoUring: return "io_uring";
+        case WriterBackend::Threads: return "threads";
+    }
+    return "?";
+}
+
+inline std::optional<WriterBackend> parseWriterBackend(std::string_view name) {
+    for (auto backend : {WriterBackend::Auto, WriterBackend::IoUring, WriterBackend::Threads}) {
+        if (name == writerBackendName(backend)) return backend;
+    }
+    return std::nullopt;
+}
+
+// One of the writer's buffers: fill it, hand it to write(), it is back in the pool once written
+struct WriteBuffer {
+    uint8_t* data;
+    size_t capacity;
+    uint32_t index;
+};
+
+/*
+ * The one place file output goes through, so no pipeline thread ever blocks on disk:
+ *  -> producers take a buffer from the writer's pool (waiting while all are in flight),
+ *     fill it and hand it to write(), which suspends the producing coroutine
+ *  -> the I/O side writes it; the completion gives the buffer back to the pool and
+ *     resumes the producer on the pumping thread
+ *
+ * On io_uring the pool is registered with the ring, so writes from it are fixed writes
+ * the kernel does not have to map each time, and the I/O thread submits everything
+ * queued since it last woke with one io_uring_enter. It sleeps in that same call,
+ * woken by completions or by an eventfd read the producers complete. Kernels without
+ * io_uring, or with it disabled, get THREADS threads calling pwrite instead.
+ */
+class AsyncWriter {
+public:
+    static constexpr uint32_t BUFFERS = 8;
+    static constexpr size_t BUFFER_BYTES = 1 << 20;
+    static constexpr unsigned THREADS = 2;
+    static constexpr uint32_t RING_ENTRIES = 64;
+
+    explicit AsyncWriter(ResumeQueue& resumes, WriterBackend requested = WriterBackend::Auto,
+                         uint32_t buffers = BUFFERS, size_t bufferBytes = BUFFER_BYTES)
+            : resumes(resumes), storage(size_t(buffers) * bufferBytes), pool(buffers) {
+        std::vector<iovec> iovecs(buffers);
+        for (uint32_t b = 0; b < buffers; b++) {
+            pool[b] = {storage.data() + b * bufferBytes, bufferBytes, b};
+            iovecs[b] = {pool[b].data, bufferBytes};
+            freeBuffers.push_back(&pool[b]);
+        }
+
+        if (requested != WriterBackend::Threads) {
+            ring.emplace(RING_ENTRIES);
+            wakeFd = eventfd(0, EFD_CLOEXEC);
+            if (ring->error() == 0 && wakeFd >= 0 &&
+                ring->supports({IORING_OP_WRITE, IORING_OP_WRITE_FIXED, IORING_OP_READ})) {
+                registered = buffers > 0 && ring->registerBuffers(iovecs.data(), buffers);
+                threads.emplace_back([this] { ringLoop(); });
+                return;
+            }
+            ring.reset();
+        }
+        for (unsigned t = 0; t < THREADS; t++) threads.emplace_back([this] { writerLoop(); });
+    }
+
+    ~AsyncWriter() {
+        {
+            std::lock_guard lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        if (ring) wakeRing();
+        for (auto& thread : threads) thread.join();
+        if (wakeFd >= 0) close(wakeFd);
+    }
+
+    AsyncWriter(const AsyncWriter&) = delete;
+    AsyncWriter& operator=(const AsyncWriter&) = delete;
+
+    [[nodiscard]] WriterBackend backend() const { return ring ? WriterBackend::IoUring : WriterBackend::Threads; }
+    [[nodiscard]] bool registeredBuffers() const { return registered; }
+
+    // co_await writer.acquire(): a buffer from the pool, for the pumping thread only
+    auto acquire() {
+        struct Awaiter {
+            AsyncWriter& writer;
+            WriteBuffer* buffer = nullptr;
+            bool await_ready() {
+                if (writer.freeBuffers.empty()) return false;
+                buffer = writer.freeBuffers.back();
+                writer.freeBuffers.pop_back();
+                return true;
+            }
+            void await_suspend(std::coroutine_handle<> handle) { writer.waiting.push_back({handle, &buffer}); }
+            WriteBuffer& await_resume() const noexcept { return *buffer; }
+        };
+        return Awaiter{*this};
+    }
+
+    // co_await writer.write(fd, buffer, bytes, offset): writes the first bytes of the buffer
+    // and gives it back to the pool; returns the bytes written, or -errno
+    auto write(int fd, WriteBuffer& buffer, size_t bytes, off_t offset) {
+        struct Awaiter {
+            AsyncWriter& writer;
+            WriteBuffer& buffer;
+            Job job;
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(std::coroutine_handle<> handle) {
+                job.waiter = handle;
+                writer.submit(&job);
+            }
+            ssize_t await_resume() {
+                writer.release(buffer);
+                return job.result;
+            }
+        };
+        return Awaiter{*this, buffer, {fd, buffer.data, bytes, offset, int(buffer.index)}};
+    }
+
+    // Same for memory outside the pool, which must stay put until then
+    auto write(int fd, const void* data, size_t bytes, off_t offset) {
+        struct Awaiter {
+            AsyncWriter& writer;
+            Job job;
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(std::coroutine_handle<> handle) {
+                job.waiter = handle;
+                writer.submit(&job);
+            }
+            ssize_t await_resume() const noexcept { return job.result; }
+        };
+        return Awaiter{*this, {fd, static_cast<const uint8_t*>(data), bytes, offset}};
+    }
+
+private:
+    struct Job {
+        int fd;
+        const uint8_t* data;
+        size_t bytes;
+        off_t offset;
+        int buffer = -1; // pool index, -1 for outside memory
+        size_t done{};
+        ssize_t result{};
+        std::coroutine_handle<> waiter{};
+    };
+
+    // Hands the buffer straight to the oldest waiter, which resumes at the next pump
+    void release(WriteBuffer& buffer) {
+        if (waiting.empty()) {
+            freeBuffers.push_back(&buffer);
+            return;
+        }
+        auto [handle, out] = waiting.front();
+        waiting.pop_front();
+        *out = &buffer;
+        resumes.post(handle);
+    }
+
+    void submit(Job* job) {
+        {
+            std::lock_guard lock(mutex);
+            jobs.push_back(job);
+        }
+        if (ring) wakeRing();
+        else wake.notify_one();
+    }
+
+    void wakeRing() const {
+        const uint64_t one = 1;
+        while (::write(wakeFd, &one, sizeof(one)) < 0 && errno == EINTR) {}
+    }
+
+    void writerLoop() {
+        while (true) {
+            Job* job;
+            {
+                std::unique_lock lock(mutex);
+                wake.wait(lock, [this] { return stopping || !jobs.empty(); });
+                if (jobs.empty()) return;
+                job = jobs.front();
+                jobs.pop_front();
+            }
+            job->result = writeAll(*job);
+            resumes.post(job->waiter);
+        }
+    }
+
+    static ssize_t writeAll(const Job& job) {
+        size_t done = 0;
+        while (done < job.bytes) {
+            ssize_t n = pwrite(job.fd, job.data + done, job.bytes - done, job.offset + off_t(done));
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0) return -errno;
+            if (n == 0) return -EIO;
+            done += size_t(n);
+        }
+        return ssize_t(done);
+    }
+
+    /*
+     * The ring's only submitter and reaper: queue every job taken since the last round,
+     * keep a read of the eventfd in flight so producers can wake it, submit and wait for
+     * any completion in one io_uring_enter. Short writes go round again for the rest.
+     */
+    void ringLoop() {
+        constexpr uint64_t WAKE = 0;
+        constexpr size_t MAX_WRITE = size_t(1) << 30;
+        std::deque<Job*> queued;
+        uint32_t inFlight = 0;
+        bool wakeArmed = false;
+        while (true) {
+            {
+                std::lock_guard lock(mutex);
+                queued.insert(queued.end(), jobs.begin(), jobs.end());
+                jobs.clear();
+                if (stopping && queued.empty() && inFlight == 0) return;
+            }
+            if (!wakeArmed) {
+                io_uring_sqe* sqe = ring->nextSqe();
+                sqe->opcode = IORING_OP_READ;
+                sqe->fd = wakeFd;
+                sqe->addr = uint64_t(&wakeCount);
+                sqe->len = sizeof(wakeCount);
+                sqe->user_data = WAKE;
+                wakeArmed = true;
+            }
+            // One entry stays for the wake-up read
+            while (!queued.empty() && inFlight + 1 < ring->capacity()) {
+                io_uring_sqe* sqe = ring->nextSqe();
+                if (!sqe) break;
+                Job& job = *queued.front();
+                queued.pop_front();
+                const bool fixed = job.buffer >= 0 && registered;
+                sqe->opcode = fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+                sqe->fd = job.fd;
+                sqe->addr = uint64_t(job.data + job.done);
+                sqe->len = uint32_t(std::min(job.bytes - job.done, MAX_WRITE));
+                sqe->off = uint64_t(job.offset) + job.done;
+                if (fixed) sqe->buf_index = uint16_t(job.buffer);
+                sqe->user_data = uint64_t(&job);
+                inFlight++;
+            }
+
+            int error = ring->submitAndWait(1);
+            if (error < 0 && error != -EBUSY && error != -EAGAIN) {
+                std::cout << "ERROR::ASYNCWRITER::IO_URING_ENTER_FAILED\n" << std::strerror(-error) << std::endl;
+                exit(EXIT_FAILURE);
+            }
+            ring->reap([&](uint64_t data, int32_t result) {
+                if (data == WAKE) {
+                    wakeArmed = false;
+                    return;
+                }
+                Job& job = *reinterpret_cast<Job*>(data);
+                inFlight--;
+                if (result == -EINTR || result == -EAGAIN) {
+                    queued.push_front(&job);
+                    return;
+                }
+                if (result > 0) {
+                    job.done += size_t(result);
+                    if (job.done < job.bytes) {
+                        queued.push_front(&job);
+                        return;
+                    }
+                }
+                job.result = result < 0 ? result : result == 0 ? -EIO : ssize_t(job.done);
+                resumes.post(job.waiter);
+            });
+        }
+    }
+
+    ResumeQueue& resumes;
+    std::vector<uint8_t> storage;
+    std::vector<WriteBuffer> pool;
+    // Pumping thread only
+    std::vector<WriteBuffer*> freeBuffers;
+    std::deque<std::pair<std::coroutine_handle<>, WriteBuffer**>> waiting;
+
+    std::optional<IoRing> ring;
+    bool registered = false;
+    int wakeFd = -1;
+    uint64_t wakeCount{};
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<Job*> jobs;
+    bool stopping = false;
+    std::vector<std::thread> threads;
+};
+
+#endif //OPERATINGSYSTEMSCLASS_FRAMEPIPELINE_H
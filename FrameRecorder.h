@@ -0,0 +1,136 @@
+#ifndef OPERATINGSYSTEMSCLASS_FRAMERECORDER_H
+#define OPERATINGSYSTEMSCLASS_FRAMERECORDER_H
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+#include "FramePipeline.h"
+#include "ParticleArrays.h"
+
+/*
+ * Writes frames to a file from the frame pipeline without holding it up:
+ *  -> record() copies the frame into buffers taken from the AsyncWriter's pool,
+ *     waiting for one whenever every buffer is in flight, and hands each full one over
+ *  -> a coroutine per buffer suspends on the write, the completion recycles the buffer
+ * so frames are written while the loop simulates the next ones, as many as the pool
+ * has room for.
+ *
+ * Every record is a FrameRecordHeader followed by count floats per array, x and y,
+ * then vx and vy for full records. Append mode keeps every frame (a recording),
+ * Overwrite mode rewrites the file from the start (a checkpoint). Flush before
+ * destroying a recorder with writes in flight.
+ */
+struct FrameRecordHeader {
+    uint64_t frame;
+    uint32_t count;
+    uint32_t arrays; // 2: x, y; 4: x, y, vx, vy
+};
+static_assert(sizeof(FrameRecordHeader) == 16);
+
+class FrameRecorder {
+public:
+    enum class Mode { Append, Overwrite };
+
+    FrameRecorder(const std::string& path, Mode mode, bool velocities, AsyncWriter& writer, ResumeQueue& resumes)
+            : mode(mode), arrays(velocities ? 4 : 2), writer(writer), resumes(resumes) {
+        fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            std::cout << "ERROR::FRAMERECORDER::OPEN_FAILED\n" << std::strerror(errno) << std::endl;
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    ~FrameRecorder() { close(fd); }
+
+    FrameRecorder(const FrameRecorder&) = delete;
+    FrameRecorder& operator=(const FrameRecorder&) = delete;
+
+    // co_await recorder.record(state, frame): returns once the frame is copied, not written
+    PipelineTask record(const ParticleArrays& state, uint64_t frame) {
+        // The previous checkpoint has to be complete before this one lands on top of it
+        if (mode == Mode::Overwrite) co_await flush();
+
+        const auto count = uint32_t(state.size());
+        const FrameRecordHeader header{frame, count, arrays};
+        const size_t arrayBytes = count * sizeof(float);
+        const std::pair<const void*, size_t> pieces[] = {{&header, sizeof(header)}, {state.x.data(), arrayBytes},
+                                                         {state.y.data(), arrayBytes}, {state.vx.data(), arrayBytes},
+                                                         {state.vy.data(), arrayBytes}};
+        off_t offset = 0;
+        if (mode == Mode::Append) {
+            offset = end;
+            end += off_t(sizeof(header) + arrays * arrayBytes);
+        }
+
+        WriteBuffer* buffer = &co_await writer.acquire();
+        size_t used = 0;
+        for (uint32_t p = 0; p <= arrays; p++) {
+            auto* from = static_cast<const uint8_t*>(pieces[p].first);
+            for (size_t left = pieces[p].second; left > 0;) {
+                if (used == buffer->capacity) {
+                    startWrite(*buffer, used, offset);
+                    offset += off_t(used);
+                    used = 0;
+                    buffer = &co_await writer.acquire();
+                }
+                const size_t n = std::min(left, buffer->capacity - used);
+                std::memcpy(buffer->data + used, from, n);
+                used += n;
+                from += n;
+                left -= n;
+            }
+        }
+        startWrite(*buffer, used, offset);
+    }
+
+    // co_await recorder.flush(): every recorded frame is in the file
+    PipelineTask flush() {
+        struct Awaiter {
+            FrameRecorder& recorder;
+            bool await_ready() const noexcept { return recorder.pending == 0; }
+            void await_suspend(std::coroutine_handle<> handle) { recorder.flushing.push_back(handle); }
+            void await_resume() const noexcept {}
+        };
+        co_await Awaiter{*this};
+    }
+
+    [[nodiscard]] bool failed() const { return writeFailed; }
+
+private:
+    void startWrite(WriteBuffer& buffer, size_t bytes, off_t offset) {
+        std::erase_if(writes, [](const PipelineTask& write) { return write.done(); });
+        pending++;
+        writes.push_back(writeBuffer(buffer, bytes, offset));
+    }
+
+    PipelineTask writeBuffer(WriteBuffer& buffer, size_t bytes, off_t offset) {
+        ssize_t written = co_await writer.write(fd, buffer, bytes, offset);
+        if (written < 0 && !writeFailed) {
+            std::cout << "ERROR::FRAMERECORDER::WRITE_FAILED\n" << std::strerror(int(-written)) << std::endl;
+            writeFailed = true;
+        }
+        if (--pending > 0) co_return;
+        for (auto handle : flushing) resumes.post(handle);
+        flushing.clear();
+    }
+
+    Mode mode;
+    uint32_t arrays;
+    int fd = -1;
+    off_t end = 0;
+    bool writeFailed = false;
+    AsyncWriter& writer;
+    ResumeQueue& resumes;
+    uint32_t pending = 0;
+    std::vector<PipelineTask> writes;
+    std::vector<std::coroutine_handle<>> flushing;
+};
+
+#endif //OPERATINGSYSTEMSCLASS_FRAMERECORDER_H
@@ -0,0 +1,282 @@
+#ifndef OPERATINGSYSTEMSCLASS_HASHEDGRID_H
+#define OPERATINGSYSTEMSCLASS_HASHEDGRID_H
+
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include "UniformGrid.h"
+
+/*
+ * Sparse counterpart of UniformGrid for huge or unbounded worlds: only occupied
+ * cells exist, found through an open addressing (linear probing) hash of the cell
+ * coordinates. The whole structure is rebuilt in bulk every step:
+ *
+ *  -> hash every particle's cell, counting particles per occupied cell
+ *  -> sort the occupied cells by (y, x) and prefix sum their counts
+ *  -> scatter the particles into slots, cell after cell
+ *  -> resolve the half shell of each occupied cell once, into slot spans
+ *
+ * Because the cells are sorted row major, horizontally adjacent occupied cells are
+ * adjacent in slot order too, and their spans merge just like a dense grid row.
+ * Memory and rebuild time scale with particles and occupied cells, never with the
+ * world area.
+ *
+ * As in BasicUniformGrid, S is the scalar of the slot positions and cells are
+ * computed in CellScalar<S>.
+ */
+template<class S>
+class BasicHashedGrid {
+public:
+    using Span = std::pair<uint32_t, uint32_t>;
+    using Coord = CellScalar<S>;
+
+    void configure(Coord width, Coord height, Coord minCellSize, bool periodicX, bool periodicY) {
+        // Same cell sizing and period limit as UniformGrid on periodic axes, unbounded cells otherwise
+        if ((periodicX && width < 3 * minCellSize) || (periodicY && height < 3 * minCellSize)) {
+            std::cout << "ERROR::HASHEDGRID::PERIOD_TOO_SMALL\n" << double(width) << " x " << double(height)
+                      << " needs at least " << 3 * double(minCellSize) << " on a periodic axis" << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        wrapX = periodicX ? int(width / minCellSize) : 0;
+        wrapY = periodicY ? int(height / minCellSize) : 0;
+        invCellX = periodicX ? Coord(wrapX) / width : Coord(1) / minCellSize;
+        invCellY = periodicY ? Coord(wrapY) / height : Coord(1) / minCellSize;
+    }
+
+    void build(const S* x, const S* y, size_t count) {
+        particleEntry.resize(count);
+        particleCell.resize(count);
+
+        size_t wanted = 16;
+        while (wanted < 2 * std::max<size_t>(occupied.size(), 8)) wanted *= 2;
+        resetTable(wanted);
+        occupied.clear();
+
+        for (size_t i = 0; i < count; i++) {
+            uint64_t key = keyOf(x[i], y[i]);
+            uint32_t entry = findOrInsert(key);
+            table[entry].count++;
+            particleEntry[i] = entry;
+        }
+
+        std::sort(occupied.begin(), occupied.end());
+        bounds = {0, 0, -1, -1};
+        if (!occupied.empty()) {
+            bounds = {unpackX(occupied[0]), unpackY(occupied.front()), unpackX(occupied[0]), unpackY(occupied.back())};
+            for (uint64_t key : occupied) {
+                bounds.minX = std::min(bounds.minX, unpackX(key));
+                bounds.maxX = std::max(bounds.maxX, unpackX(key));
+            }
+        }
+        cellStart.resize(occupied.size() + 1);
+        cellStart[0] = 0;
+        for (uint32_t c = 0; c < occupied.size(); c++) {
+            Entry& entry = table[find(occupied[c])];
+            entry.cell = c;
+            cellStart[c + 1] = cellStart[c] + entry.count;
+        }
+
+        slotParticle.resize(count);
+        slotX.resize(count);
+        slotY.resize(count);
+        fill.assign(cellStart.begin(), cellStart.end() - 1);
+        for (size_t i = 0; i < count; i++) {
+            uint32_t cell = table[particleEntry[i]].cell;
+            particleCell[i] = cell;
+            uint32_t slot = fill[cell]++;
+            slotParticle[slot] = uint32_t(i);
+            slotX[slot] = x[i];
+            slotY[slot] = y[i];
+        }
+
+        resolveNeighbours();
+    }
+
+    [[nodiscard]] uint32_t homeCellCount() const { return uint32_t(occupied.size()); }
+    [[nodiscard]] uint32_t homeCell(uint32_t k) const { return k; }
+
+    // Every cell of the table is occupied, so there is nothing to skip
+    template<class Fn>
+    void forEachOccupiedCell(uint32_t begin, uint32_t end, Fn&& fn) const {
+        for (uint32_t k = begin; k < end; k++) fn(k);
+    }
+
+    // Same half shell as UniformGrid: (x + 1, y) and (x - 1..x + 1, y + 1)
+    template<class Fn>
+    void forEachForwardSpan(uint32_t cell, Fn&& fn) const {
+        for (uint32_t s = spanStart[cell]; s < spanStart[cell + 1]; s++) {
+            fn(spans[s].first, spans[s].second);
+        }
+    }
+
+    [[nodiscard]] size_t occupiedCells() const { return occupied.size(); }
+
+    [[nodiscard]] int64_t cellX(Coord x) const { return cellCoord(x, invCellX, wrapX); }
+    [[nodiscard]] int64_t cellY(Coord y) const { return cellCoord(y, invCellY, wrapY); }
+
+    // Bounding box of the occupied cells of the last build
+    [[nodiscard]] CellBounds cellBounds() const { return bounds; }
+
+    // Calls fn(begin, end) with the slots of the occupied cells in [x0, x1] x [y0, y1]. Small
+    // ranges probe the table cell by cell, ranges larger than the occupied set scan it instead.
+    template<class Fn>
+    void forEachCellSpanIn(int64_t x0, int64_t y0, int64_t x1, int64_t y1, Fn&& fn) const {
+        x0 = std::max(x0, bounds.minX);
+        y0 = std::max(y0, bounds.minY);
+        x1 = std::min(x1, bounds.maxX);
+        y1 = std::min(y1, bounds.maxY);
+        if (x0 > x1 || y0 > y1) return;
+
+        if (double(x1 - x0 + 1) * double(y1 - y0 + 1) > double(occupied.size())) {
+            for (uint32_t c = 0; c < occupied.size(); c++) {
+                int64_t cx = unpackX(occupied[c]), cy = unpackY(occupied[c]);
+                if (cx >= x0 && cx <= x1 && cy >= y0 && cy <= y1) fn(cellStart[c], cellStart[c + 1]);
+            }
+            return;
+        }
+        for (int64_t cy = y0; cy <= y1; cy++) {
+            for (int64_t cx = x0; cx <= x1; cx++) {
+                uint32_t e = find(pack(cx, cy));
+                if (e <= mask) fn(cellStart[table[e].cell], cellStart[table[e].cell + 1]);
+            }
+        }
+    }
+
+    Coord invCellX{}, invCellY{};
+
+    std::vector<uint32_t> cellStart;
+    std::vector<uint32_t> particleCell;
+    std::vector<uint32_t> slotParticle;
+    std::vector<S> slotX, slotY;
+
+private:
+    struct Entry {
+        uint64_t key;
+        uint32_t cell;
+        uint32_t count;
+    };
+
+    static constexpr uint64_t EMPTY = ~uint64_t(0);
+    // In slot order, so the row above merges into one span when its cells are all occupied
+    static constexpr std::pair<int, int> HALF_SHELL[] = {{1, 0}, {-1, 1}, {0, 1}, {1, 1}};
+    // Keeps the biased coordinates far from EMPTY and from overflowing on +-1
+    static constexpr int64_t COORD_LIMIT = int64_t(1) << 30;
+
+    // Biased so that ordering the keys as integers orders the cells by (y, x)
+    static uint64_t pack(int64_t cx, int64_t cy) {
+        return uint64_t(cy + (int64_t(1) << 31)) << 32 | uint64_t(cx + (int64_t(1) << 31));
+    }
+    static int64_t unpackX(uint64_t key) { return int64_t(key & 0xffffffffu) - (int64_t(1) << 31); }
+    static int64_t unpackY(uint64_t key) { return int64_t(key >> 32) - (int64_t(1) << 31); }
+
+    static int64_t cellCoord(Coord p, Coord invCell, int wrap) {
+        auto c = int64_t(std::floor(double(p) * invCell));
+        if (wrap) return std::clamp<int64_t>(c, 0, wrap - 1);
+        return std::clamp(c, -COORD_LIMIT, COORD_LIMIT);
+    }
+
+    static int64_t neighbourCoord(int64_t c, int d, int wrap) {
+        c += d;
+        if (wrap) c = (c + wrap) % wrap;
+        return c;
+    }
+
+    [[nodiscard]] uint64_t keyOf(S x, S y) const {
+        return pack(cellCoord(Coord(x), invCellX, wrapX), cellCoord(Coord(y), invCellY, wrapY));
+    }
+
+    [[nodiscard]] uint32_t home(uint64_t key) const {
+        return uint32_t((key * 0x9E3779B97F4A7C15ull) >> shift);
+    }
+
+    void resetTable(size_t capacity) {
+        table.assign(capacity, Entry{EMPTY, 0, 0});
+        mask = uint32_t(capacity - 1);
+        shift = 64 - std::countr_zero(capacity);
+    }
+
+    [[nodiscard]] uint32_t find(uint64_t key) const {
+        uint32_t e = home(key);
+        while (table[e].key != key) {
+            if (table[e].key == EMPTY) return mask + 1;
+            e = (e + 1) & mask;
+        }
+        return e;
+    }
+
+    uint32_t findOrInsert(uint64_t key) {
+        uint32_t e = home(key);
+        while (table[e].key != key) {
+            if (table[e].key == EMPTY) {
+                // Keep the load factor at or below one half
+                if (2 * (occupied.size() + 1) > table.size()) {
+                    grow();
+                    return findOrInsert(key);
+                }
+                table[e] = {key, 0, 0};
+                occupied.push_back(key);
+                return e;
+            }
+            e = (e + 1) & mask;
+        }
+        return e;
+    }
+
+    // Entry indices change, so the particles hashed so far are remapped by key
+    void grow() {
+        std::vector<Entry> old = std::move(table);
+        resetTable(old.size() * 2);
+        std::vector<uint32_t> moved(old.size());
+        for (uint32_t o = 0; o < old.size(); o++) {
+            if (old[o].key == EMPTY) continue;
+            uint32_t e = home(old[o].key);
+            while (table[e].key != EMPTY) e = (e + 1) & mask;
+            table[e] = old[o];
+            moved[o] = e;
+        }
+        for (auto& entry : particleEntry) {
+            if (entry < old.size() && old[entry].key != EMPTY) entry = moved[entry];
+        }
+    }
+
+    void resolveNeighbours() {
+        spanStart.resize(occupied.size() + 1);
+        spans.clear();
+        for (uint32_t c = 0; c < occupied.size(); c++) {
+            spanStart[c] = uint32_t(spans.size());
+            int64_t cx = unpackX(occupied[c]), cy = unpackY(occupied[c]);
+            for (auto [dx, dy] : HALF_SHELL) {
+                uint32_t e = find(pack(neighbourCoord(cx, dx, wrapX), neighbourCoord(cy, dy, wrapY)));
+                if (e > mask) continue;
+                Span span{cellStart[table[e].cell], cellStart[table[e].cell + 1]};
+                if (spans.size() > spanStart[c] && spans.back().second == span.first) {
+                    spans.back().second = span.second;
+                } else {
+                    spans.push_back(span);
+                }
+            }
+        }
+        spanStart[occupied.size()] = uint32_t(spans.size());
+    }
+
+    int wrapX{}, wrapY{};
+    CellBounds bounds{0, 0, -1, -1};
+
+    std::vector<Entry> table;
+    uint32_t mask{};
+    int shift{};
+
+    std::vector<uint64_t> occupied;
+    std::vector<uint32_t> particleEntry;
+    std::vector<uint32_t> fill;
+    std::vector<uint32_t> spanStart;
+    std::vector<Span> spans;
+};
+
+using HashedGrid = BasicHashedGrid<float>;
+
+#endif //OPERATINGSYSTEMSCLASS_HASHEDGRID_H
@@ -0,0 +1,140 @@
+#ifndef OPERATINGSYSTEMSCLASS_IDLEWAIT_H
+#define OPERATINGSYSTEMSCLASS_IDLEWAIT_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <thread>
+
+/*
+ * Waiting for another thread, as the pool's workers do between loops and the caller
+ * does at the end of one:
+ *  -> spin on the value with the CPU's pause hint for a calibrated window, which
+ *     catches the sub-millisecond gaps between a step's phases without a syscall
+ *  -> then, depending on the strategy, keep spinning, yield the core, or sleep in
+ *     the kernel until woken (std::atomic::wait, a futex on Linux)
+ *
+ * Spin wastes a core but reacts fastest, Sleep frees it but pays the wake-up, Yield
+ * sits in between and only helps when there are more threads than cores.
+ */
+enum class IdleStrategy {
+    Spin,
+    Yield,
+    Sleep,
+};
+
+inline const char* idleStrategyName(IdleStrategy strategy) {
+    switch (strategy) {
+        case IdleStrategy::Spin: return "spin";
+        case IdleStrategy::Yield: return "yield";
+        case IdleStrategy::Sleep: return "sleep";
+    }
+    return "?";
+}
+
+inline std::optional<IdleStrategy> parseIdleStrategy(std::string_view name) {
+    for (auto strategy : {IdleStrategy::Spin, IdleStrategy::Yield, IdleStrategy::Sleep}) {
+        if (name == idleStrategyName(strategy)) return strategy;
+    }
+    return std::nullopt;
+}
+
+struct IdlePolicy {
+    IdleStrategy strategy = IdleStrategy::Sleep;
+    // How long to spin before yielding or sleeping
+    std::chrono::nanoseconds spinWindow = std::chrono::microseconds(20);
+};
+
+inline void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+// Pause instructions that fit in window on this machine, measured once per call
+inline uint32_t calibrateSpins(std::chrono::nanoseconds window) {
+    constexpr uint32_t SAMPLE = 4096;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < SAMPLE; i++) cpuRelax();
+    auto took = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    double perSpin = std::max(took / SAMPLE, 0.1);
+    return uint32_t(std::min(double(window.count()) / perSpin, 1e9));
+}
+
+// Wait times in power of two buckets: bucket b counts waits of [2^b, 2^(b + 1)) ns
+struct WaitHistogram {
+    static constexpr int BUCKETS = 40;
+    std::array<uint64_t, BUCKETS> counts{};
+
+    static int bucketOf(uint64_t nanoseconds) {
+        return std::min(BUCKETS - 1, int(std::bit_width(nanoseconds | 1)) - 1);
+    }
+
+    void add(uint64_t nanoseconds) { counts[bucketOf(nanoseconds)]++; }
+
+    void merge(const WaitHistogram& other) {
+        for (int b = 0; b < BUCKETS; b++) counts[b] += other.counts[b];
+    }
+
+    [[nodiscard]] uint64_t total() const {
+        uint64_t sum = 0;
+        for (uint64_t c : counts) sum += c;
+        return sum;
+    }
+
+    // Upper edge of the bucket holding the p-th fraction of the waits, in nanoseconds
+    [[nodiscard]] uint64_t percentile(double p) const {
+        const uint64_t all = total();
+        if (all == 0) return 0;
+        const auto rank = uint64_t(p * double(all - 1));
+        uint64_t seen = 0;
+        for (int b = 0; b < BUCKETS; b++) {
+            seen += counts[b];
+            if (seen > rank) return uint64_t(2) << b;
+        }
+        return uint64_t(2) << (BUCKETS - 1);
+    }
+};
+
+// Single writer histogram others may read at any time, one per waiting thread
+struct alignas(64) WaitRecorder {
+    std::array<std::atomic<uint64_t>, WaitHistogram::BUCKETS> counts{};
+
+    void add(uint64_t nanoseconds) {
+        auto& count = counts[WaitHistogram::bucketOf(nanoseconds)];
+        count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    void addTo(WaitHistogram& histogram) const {
+        for (int b = 0; b < WaitHistogram::BUCKETS; b++) histogram.counts[b] += counts[b].load(std::memory_order_relaxed);
+    }
+
+    void reset() {
+        for (auto& count : counts) count.store(0, std::memory_order_relaxed);
+    }
+};
+
+// Returns once value no longer holds old
+template<class T>
+void idleWait(const std::atomic<T>& value, T old, IdleStrategy strategy, uint32_t spins) {
+    for (uint32_t i = 0; i < spins; i++) {
+        if (value.load(std::memory_order_acquire) != old) return;
+        cpuRelax();
+    }
+    while (value.load(std::memory_order_acquire) == old) {
+        switch (strategy) {
+            case IdleStrategy::Spin: cpuRelax(); break;
+            case IdleStrategy::Yield: std::this_thread::yield(); break;
+            case IdleStrategy::Sleep: value.wait(old, std::memory_order_acquire); break;
+        }
+    }
+}
+
+#endif //OPERATINGSYSTEMSCLASS_IDLEWAIT_H
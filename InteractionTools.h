@@ -0,0 +1,52 @@
+#ifndef OPERATINGSYSTEMSCLASS_INTERACTIONTOOLS_H
+#define OPERATINGSYSTEMSCLASS_INTERACTIONTOOLS_H
+
+#include <cmath>
+#include "CollisionSolver.h"
+#include "ParticleArrays.h"
+
+enum class ToolKind : uint8_t {
+    Attract, // pull towards the cursor
+    Repel,   // push away from the cursor
+    Drag,    // match the cursor's velocity
+};
+
+// One frame of a mouse tool, in world coordinates
+struct ToolAction {
+    ToolKind kind{};
+    float x{}, y{};
+    float radius{};
+    float strength{};
+    float cursorVX{}, cursorVY{}; // world units per frame, used by Drag
+};
+
+/*
+ * Adds the tool's force to the particles under it. Only the grid cells covered by
+ * the tool are visited, so the cost follows the size of the affected region rather
+ * than the particle count. The force fades linearly to zero at the tool's edge.
+ */
+inline void applyTool(const CollisionSolver& solver, ParticleArrays& state, const ToolAction& tool) {
+    solver.forEachParticleNear(state, tool.x, tool.y, tool.radius, [&](uint32_t i) {
+        float dx = tool.x - state.x[i], dy = tool.y - state.y[i];
+        float distance = std::sqrt(dx * dx + dy * dy);
+        float falloff = 1.0f - distance / tool.radius;
+
+        switch (tool.kind) {
+            case ToolKind::Attract:
+            case ToolKind::Repel: {
+                if (distance <= 0.0f) return;
+                float sign = tool.kind == ToolKind::Attract ? 1.0f : -1.0f;
+                float scale = sign * tool.strength * falloff / distance;
+                state.fx[i] += dx * scale;
+                state.fy[i] += dy * scale;
+                break;
+            }
+            case ToolKind::Drag:
+                state.fx[i] += (tool.cursorVX - state.vx[i]) * falloff;
+                state.fy[i] += (tool.cursorVY - state.vy[i]) * falloff;
+                break;
+        }
+    });
+}
+
+#endif //OPERATINGSYSTEMSCLASS_INTERACTIONTOOLS_H
@@ -0,0 +1,160 @@
+#ifndef OPERATINGSYSTEMSCLASS_IORING_H
+#define OPERATINGSYSTEMSCLASS_IORING_H
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+
+/*
+ * Just enough of io_uring for AsyncWriter, on the raw syscalls:
+ *  -> the kernel shares two rings with us, submissions (SQ) and completions (CQ)
+ *  -> we fill entries at the SQ tail and publish it, the kernel picks them up on
+ *     io_uring_enter; it fills CQ entries at the CQ tail, we consume them from the head
+ *
+ * One thread at a time may submit and one reap, which in AsyncWriter is its I/O thread
+ * doing both. The head and tail indices the kernel also touches are read and written
+ * through atomic_ref, with acquire and release as the io_uring ABI asks.
+ */
+class IoRing {
+public:
+    explicit IoRing(uint32_t entries) {
+        io_uring_params params{};
+        fd = int(syscall(__NR_io_uring_setup, entries, &params));
+        if (fd < 0) {
+            failure = errno;
+            return;
+        }
+        sqRingBytes = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+        cqRingBytes = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        // Kernels with a single mmap for both rings map them at the same offset
+        const bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single) sqRingBytes = cqRingBytes = std::max(sqRingBytes, cqRingBytes);
+
+        sqRing = map(sqRingBytes, IORING_OFF_SQ_RING);
+        cqRing = single ? sqRing : map(cqRingBytes, IORING_OFF_CQ_RING);
+        sqes = static_cast<io_uring_sqe*>(map(params.sq_entries * sizeof(io_uring_sqe), IORING_OFF_SQES));
+        sqeBytes = params.sq_entries * sizeof(io_uring_sqe);
+        if (!sqRing || !cqRing || !sqes) {
+            failure = errno;
+            return;
+        }
+
+        auto at = [](void* ring, uint32_t offset) { return reinterpret_cast<uint32_t*>(static_cast<uint8_t*>(ring) + offset); };
+        sqHead = at(sqRing, params.sq_off.head);
+        sqTail = at(sqRing, params.sq_off.tail);
+        sqMask = *at(sqRing, params.sq_off.ring_mask);
+        sqArray = at(sqRing, params.sq_off.array);
+        cqHead = at(cqRing, params.cq_off.head);
+        cqTail = at(cqRing, params.cq_off.tail);
+        cqMask = *at(cqRing, params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(static_cast<uint8_t*>(cqRing) + params.cq_off.cqes);
+        sqEntries = params.sq_entries;
+    }
+
+    ~IoRing() {
+        if (sqes) munmap(sqes, sqeBytes);
+        if (cqRing && cqRing != sqRing) munmap(cqRing, cqRingBytes);
+        if (sqRing) munmap(sqRing, sqRingBytes);
+        if (fd >= 0) close(fd);
+    }
+
+    IoRing(const IoRing&) = delete;
+    IoRing& operator=(const IoRing&) = delete;
+
+    // 0 when usable, otherwise the errno that stopped the setup
+    [[nodiscard]] int error() const { return failure; }
+    [[nodiscard]] uint32_t capacity() const { return sqEntries; }
+
+    // Whether the kernel knows every one of ops (the probe itself needs 5.6)
+    [[nodiscard]] bool supports(std::initializer_list<uint8_t> ops) const {
+        constexpr unsigned OPS = 64;
+        alignas(io_uring_probe) uint8_t storage[sizeof(io_uring_probe) + OPS * sizeof(io_uring_probe_op)]{};
+        auto* probe = reinterpret_cast<io_uring_probe*>(storage);
+        if (registerOp(IORING_REGISTER_PROBE, probe, OPS) < 0) return false;
+        for (uint8_t op : ops) {
+            if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) return false;
+        }
+        return true;
+    }
+
+    // Pins the buffers so fixed writes skip mapping them per request; false leaves them unregistered
+    bool registerBuffers(const iovec* buffers, unsigned count) {
+        return registerOp(IORING_REGISTER_BUFFERS, buffers, count) == 0;
+    }
+
+    // Next free submission entry, zeroed, or nullptr while the ring is full
+    io_uring_sqe* nextSqe() {
+        const uint32_t head = std::atomic_ref(*sqHead).load(std::memory_order_acquire);
+        if (localTail - head >= sqEntries) return nullptr;
+        const uint32_t index = localTail & sqMask;
+        io_uring_sqe* sqe = &sqes[index];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sqArray[index] = index;
+        localTail++;
+        return sqe;
+    }
+
+    // Publishes the entries filled since the last call and waits for at least minComplete
+    // completions; returns 0 or -errno
+    int submitAndWait(uint32_t minComplete) {
+        std::atomic_ref(*sqTail).store(localTail, std::memory_order_release);
+        uint32_t toSubmit = localTail - submitted;
+        while (true) {
+            int n = int(syscall(__NR_io_uring_enter, fd, toSubmit, minComplete,
+                                minComplete ? IORING_ENTER_GETEVENTS : 0, nullptr, 0));
+            if (n >= 0) {
+                submitted += uint32_t(n);
+                toSubmit -= uint32_t(n);
+                if (toSubmit == 0) return 0;
+                continue;
+            }
+            if (errno == EINTR) continue;
+            return -errno;
+        }
+    }
+
+    // Calls fn(userData, result) for every completion posted so far, returns how many
+    template<class Fn>
+    uint32_t reap(Fn&& fn) {
+        uint32_t head = *cqHead;
+        const uint32_t tail = std::atomic_ref(*cqTail).load(std::memory_order_acquire);
+        const uint32_t count = tail - head;
+        for (; head != tail; head++) {
+            const io_uring_cqe& cqe = cqes[head & cqMask];
+            fn(cqe.user_data, cqe.res);
+        }
+        std::atomic_ref(*cqHead).store(head, std::memory_order_release);
+        return count;
+    }
+
+private:
+    void* map(size_t bytes, off_t offset) const {
+        void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+        return p == MAP_FAILED ? nullptr : p;
+    }
+
+    int registerOp(unsigned opcode, const void* arg, unsigned count) const {
+        return int(syscall(__NR_io_uring_register, fd, opcode, arg, count));
+    }
+
+    int fd = -1;
+    int failure = 0;
+    void* sqRing = nullptr;
+    void* cqRing = nullptr;
+    size_t sqRingBytes{}, cqRingBytes{}, sqeBytes{};
+    io_uring_sqe* sqes = nullptr;
+    io_uring_cqe* cqes = nullptr;
+    uint32_t *sqHead{}, *sqTail{}, *sqArray{}, *cqHead{}, *cqTail{};
+    uint32_t sqMask{}, cqMask{}, sqEntries{};
+    uint32_t localTail = 0, submitted = 0;
+};
+
+#endif //OPERATINGSYSTEMSCLASS_IORING_H
@@ -0,0 +1,234 @@
+#ifndef OPERATINGSYSTEMSCLASS_PARALLELPRIMITIVES_H
+#define OPERATINGSYSTEMSCLASS_PARALLELPRIMITIVES_H
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <type_traits>
+#include <vector>
+#include "ThreadPool.h"
+
+/*
+ * Building blocks on the worker pool, for arrays of a thousand to a hundred million
+ * elements:
+ *  -> parallelReduce, parallelSum, parallelMinMax
+ *  -> exclusiveScan
+ *  -> compact: the elements a predicate keeps, in their original order
+ *  -> RadixSorter: LSD radix sort of 32 or 64 bit keys carrying a value each
+ *
+ * Reductions, scans and compaction split the array into blocks of about
+ * PRIMITIVE_BLOCK elements and combine them in order, so a float sum depends on the
+ * length alone, not on the pool's size. Arrays of one block run on the caller without
+ * waking the pool, as does a nullptr pool.
+ */
+// Small enough that 10^5 elements already spread over a few workers, large enough
+// that a block's work dwarfs handing it out
+constexpr size_t PRIMITIVE_BLOCK = 32768;
+
+inline size_t primitiveBlocks(size_t n) { return (n + PRIMITIVE_BLOCK - 1) / PRIMITIVE_BLOCK; }
+
+// Calls fn(b, begin, end) for each of blocks even blocks splitting [0, n)
+template<class Fn>
+void forEachBlock(ThreadPool* pool, size_t n, size_t blocks, Fn&& fn) {
+    auto run = [&](size_t b0, size_t b1, unsigned) {
+        for (size_t b = b0; b < b1; b++) fn(b, n * b / blocks, n * (b + 1) / blocks);
+    };
+    if (pool && blocks > 1) pool->parallelFor(0, blocks, 1, run);
+    else run(0, blocks, 0);
+}
+
+// combine(identity, map(0)), ... over [0, n), in block order; combine has to be associative
+template<class T, class Map, class Combine>
+T parallelReduce(ThreadPool* pool, size_t n, T identity, Map&& map, Combine&& combine) {
+    std::vector<T> partial(primitiveBlocks(n), identity);
+    forEachBlock(pool, n, primitiveBlocks(n), [&](size_t b, size_t begin, size_t end) {
+        T acc = identity;
+        for (size_t i = begin; i < end; i++) acc = combine(acc, map(i));
+        partial[b] = acc;
+    });
+    T acc = identity;
+    for (const T& p : partial) acc = combine(acc, p);
+    return acc;
+}
+
+template<class T>
+T parallelSum(ThreadPool* pool, std::span<const T> values) {
+    return parallelReduce(pool, values.size(), T{}, [&](size_t i) { return values[i]; },
+                          [](T a, T b) { return a + b; });
+}
+
+template<class T>
+struct MinMax {
+    T min = std::numeric_limits<T>::max();
+    T max = std::numeric_limits<T>::lowest();
+};
+
+template<class T>
+MinMax<T> parallelMinMax(ThreadPool* pool, std::span<const T> values) {
+    return parallelReduce(pool, values.size(), MinMax<T>{}, [&](size_t i) { return MinMax<T>{values[i], values[i]}; },
+                          [](MinMax<T> a, MinMax<T> b) { return MinMax<T>{std::min(a.min, b.min), std::max(a.max, b.max)}; });
+}
+
+// out[i] = in[0] + ... + in[i - 1], returns the sum of everything; in and out may be the same array
+template<class T>
+T exclusiveScan(ThreadPool* pool, std::span<const T> in, std::span<T> out) {
+    const size_t n = in.size();
+    std::vector<T> offsets(primitiveBlocks(n));
+    forEachBlock(pool, n, primitiveBlocks(n), [&](size_t b, size_t begin, size_t end) {
+        T sum{};
+        for (size_t i = begin; i < end; i++) sum += in[i];
+        offsets[b] = sum;
+    });
+    T total{};
+    for (T& offset : offsets) {
+        T sum = offset;
+        offset = total;
+        total += sum;
+    }
+    forEachBlock(pool, n, primitiveBlocks(n), [&](size_t b, size_t begin, size_t end) {
+        T acc = offsets[b];
+        for (size_t i = begin; i < end; i++) {
+            T value = in[i];
+            out[i] = acc;
+            acc += value;
+        }
+    });
+    return total;
+}
+
+/*
+ * Calls move(i, k) for the k-th index i in [0, n) that keep(i) accepts, k counting
+ * from 0 in index order, and returns how many there were. keep runs twice per index,
+ * counting then moving, so it should be cheap and give the same answer both times.
+ * Blocks move concurrently, so move has to write somewhere keep and move do not read:
+ * a second set of arrays, not the first ones compacted in place.
+ */
+template<class Keep, class Move>
+size_t compact(ThreadPool* pool, size_t n, Keep&& keep, Move&& move) {
+    std::vector<size_t> offsets(primitiveBlocks(n));
+    forEachBlock(pool, n, primitiveBlocks(n), [&](size_t b, size_t begin, size_t end) {
+        size_t kept = 0;
+        for (size_t i = begin; i < end; i++) kept += keep(i) ? 1 : 0;
+        offsets[b] = kept;
+    });
+    size_t total = 0;
+    for (size_t& offset : offsets) {
+        size_t kept = offset;
+        offset = total;
+        total += kept;
+    }
+    forEachBlock(pool, n, primitiveBlocks(n), [&](size_t b, size_t begin, size_t end) {
+        size_t k = offsets[b];
+        for (size_t i = begin; i < end; i++) {
+            if (keep(i)) move(i, k++);
+        }
+    });
+    return total;
+}
+
+// Unsigned key ordered like the float, negatives included, for sorting floats by radix
+inline uint32_t floatSortKey(float f) {
+    const auto u = std::bit_cast<uint32_t>(f);
+    return u & 0x80000000u ? ~u : u | 0x80000000u;
+}
+
+inline uint64_t floatSortKey(double d) {
+    const auto u = std::bit_cast<uint64_t>(d);
+    return u & 0x8000000000000000u ? ~u : u | 0x8000000000000000u;
+}
+
+/*
+ * LSD radix sort, one byte of the key per pass:
+ *  -> every block counts its keys' digits
+ *  -> the counts are scanned digit major, block minor, giving each block where its
+ *     run of every digit starts
+ *  -> every block scatters its keys and values there, in order, so the sort is stable
+ * Keys and values ping-pong with the sorter's scratch arrays, which stay allocated
+ * for the next sort. A first read of the keys finds the bytes every key shares, and
+ * their passes are skipped: 64 bit cell or Morton keys of a small world take a few
+ * passes, not eight.
+ */
+template<class Key, class Value>
+class RadixSorter {
+    static_assert(std::is_unsigned_v<Key> && (sizeof(Key) == 4 || sizeof(Key) == 8));
+
+public:
+    // Sorts keys ascending and values along with them; both have to be the same length
+    void sort(ThreadPool* pool, std::span<Key> keys, std::span<Value> values) {
+        const size_t n = keys.size();
+        if (n < 2) return;
+        const unsigned workers = pool ? pool->size() : 1;
+        blocks = std::clamp<size_t>(n / MIN_RADIX_BLOCK, 1, size_t(workers) * BLOCKS_PER_WORKER);
+        counts.resize(blocks * RADIX);
+        if (keyScratch.size() < n) {
+            keyScratch.resize(n);
+            valueScratch.resize(n);
+        }
+
+        // Bits that differ between any key and the first one; only their bytes need a pass
+        const Key first = keys[0];
+        const Key differing = parallelReduce(pool, n, Key{0}, [&](size_t i) { return Key(keys[i] ^ first); },
+                                             [](Key a, Key b) { return Key(a | b); });
+
+        std::span<Key> keyFrom = keys, keyTo(keyScratch.data(), n);
+        std::span<Value> valueFrom = values, valueTo(valueScratch.data(), n);
+        for (unsigned shift = 0; shift < 8 * sizeof(Key); shift += DIGIT_BITS) {
+            if (((differing >> shift) & DIGIT_MASK) == 0) continue;
+            pass(pool, shift, keyFrom, keyTo, valueFrom, valueTo);
+            std::swap(keyFrom, keyTo);
+            std::swap(valueFrom, valueTo);
+        }
+        if (keyFrom.data() != keys.data()) {
+            forEachBlock(pool, n, blocks, [&](size_t, size_t begin, size_t end) {
+                std::copy(keyFrom.begin() + begin, keyFrom.begin() + end, keys.begin() + begin);
+                std::copy(valueFrom.begin() + begin, valueFrom.begin() + end, values.begin() + begin);
+            });
+        }
+    }
+
+private:
+    static constexpr unsigned DIGIT_BITS = 8;
+    static constexpr size_t RADIX = size_t(1) << DIGIT_BITS;
+    static constexpr Key DIGIT_MASK = Key(RADIX - 1);
+    // Every block keeps RADIX write positions; below this many keys a block's
+    // scatter would be mostly partial cache lines
+    static constexpr size_t MIN_RADIX_BLOCK = 16384;
+    static constexpr size_t BLOCKS_PER_WORKER = 2;
+
+    void pass(ThreadPool* pool, unsigned shift, std::span<const Key> keyFrom, std::span<Key> keyTo,
+              std::span<const Value> valueFrom, std::span<Value> valueTo) {
+        const size_t n = keyFrom.size();
+        auto digit = [shift](Key key) { return size_t((key >> shift) & DIGIT_MASK); };
+
+        forEachBlock(pool, n, blocks, [&](size_t b, size_t begin, size_t end) {
+            uint32_t* count = &counts[b * RADIX];
+            std::fill(count, count + RADIX, 0u);
+            for (size_t i = begin; i < end; i++) count[digit(keyFrom[i])]++;
+        });
+        uint32_t total = 0;
+        for (size_t d = 0; d < RADIX; d++) {
+            for (size_t b = 0; b < blocks; b++) {
+                uint32_t c = counts[b * RADIX + d];
+                counts[b * RADIX + d] = total;
+                total += c;
+            }
+        }
+        forEachBlock(pool, n, blocks, [&](size_t b, size_t begin, size_t end) {
+            uint32_t* next = &counts[b * RADIX];
+            for (size_t i = begin; i < end; i++) {
+                uint32_t slot = next[digit(keyFrom[i])]++;
+                keyTo[slot] = keyFrom[i];
+                valueTo[slot] = valueFrom[i];
+            }
+        });
+    }
+
+    size_t blocks = 1;
+    std::vector<uint32_t> counts;
+    std::vector<Key> keyScratch;
+    std::vector<Value> valueScratch;
+};
+
+#endif //OPERATINGSYSTEMSCLASS_PARALLELPRIMITIVES_H
@@ -0,0 +1,60 @@
+#ifndef OPERATINGSYSTEMSCLASS_PARTICLEARRAYS_H
+#define OPERATINGSYSTEMSCLASS_PARTICLEARRAYS_H
+
+#include <vector>
+#include <cstddef>
+
+// Non-owning window over a range of SoA arrays, e.g. one scene of an ensemble
+// packed into shared arrays. Indexing matches ParticleArrays.
+template<class S>
+struct BasicParticleView {
+    S *x{}, *y{};
+    S *vx{}, *vy{};
+    S *fx{}, *fy{};
+    size_t count{};
+
+    [[nodiscard]] size_t size() const { return count; }
+};
+
+// Structure of arrays for the solver state, so the collision kernel can load
+// several particles per SIMD register. The Particle struct in main.cpp is only
+// the vertex layout uploaded to the GPU. S is the solver's scalar, see Scalar.h.
+template<class S>
+struct BasicParticleArrays {
+    std::vector<S> x, y;
+    std::vector<S> vx, vy;
+    // Accumulated during a frame, turned into velocity and cleared by the solver's step
+    std::vector<S> fx, fy;
+
+    [[nodiscard]] size_t size() const { return x.size(); }
+
+    void resize(size_t count) {
+        x.resize(count);
+        y.resize(count);
+        vx.resize(count);
+        vy.resize(count);
+        fx.resize(count);
+        fy.resize(count);
+    }
+
+    [[nodiscard]] BasicParticleView<S> view(size_t begin, size_t count) {
+        return {x.data() + begin, y.data() + begin, vx.data() + begin, vy.data() + begin,
+                fx.data() + begin, fy.data() + begin, count};
+    }
+
+    [[nodiscard]] BasicParticleView<S> view() { return view(0, size()); }
+
+    void push(S px, S py, S pvx, S pvy) {
+        x.push_back(px);
+        y.push_back(py);
+        vx.push_back(pvx);
+        vy.push_back(pvy);
+        fx.push_back(S(0));
+        fy.push_back(S(0));
+    }
+};
+
+using ParticleView = BasicParticleView<float>;
+using ParticleArrays = BasicParticleArrays<float>;
+
+#endif //OPERATINGSYSTEMSCLASS_PARTICLEARRAYS_H
@@ -0,0 +1,56 @@
+#include "ParticleSim.h"
+
+ParticleWorld::ParticleWorld(const SolverConfig& config, unsigned threads) : solver(config), pool(threads) {}
+
+void ParticleWorld::setConfig(const SolverConfig& config) {
+    solver.setConfig(config);
+}
+
+uint32_t ParticleWorld::addParticle(float x, float y, float vx, float vy) {
+    state.push(x, y, vx, vy);
+    return uint32_t(state.size() - 1);
+}
+
+void ParticleWorld::addParticles(std::span<const float> x, std::span<const float> y,
+                                 std::span<const float> vx, std::span<const float> vy) {
+    for (size_t i = 0; i < x.size(); i++) state.push(x[i], y[i], vx[i], vy[i]);
+}
+
+void ParticleWorld::addParticles(const ParticleArrays& particles) {
+    addParticles(particles.x, particles.y, particles.vx, particles.vy);
+}
+
+void ParticleWorld::step(uint32_t steps) {
+    step(steps, {});
+}
+
+void ParticleWorld::step(uint32_t steps, const RegionFn& onRegion) {
+    static const RegionFn none;
+    while (steps > 0) {
+        // The last step of a block runs untiled, so the solver's grid and contact count describe the whole world
+        uint32_t block = std::min(steps, std::max(1u, tiling.substeps));
+        uint32_t untiled = 1;
+        if (block > 1 && !tiles.advance(state, config(), forceStage, block - 1, tiling.tileParticles, pool)) {
+            untiled = block;
+        }
+        for (uint32_t s = 0; s < untiled; s++) {
+            forceStage.apply(state, pool);
+            const bool last = block == steps && s + 1 == untiled;
+            solver.step(state.view(), &pool, last ? onRegion : none);
+        }
+        frameIndex += block;
+        steps -= block;
+    }
+}
+
+void ParticleWorld::prefault(uint32_t steps) {
+    ParticleArrays saved = state;
+    const uint64_t frame = frameIndex;
+    step(steps);
+    state = saved;
+    frameIndex = frame;
+}
+
+void ParticleWorld::applyTool(const ToolAction& tool) {
+    ::applyTool(solver, state, tool);
+}
@@ -0,0 +1,79 @@
+#ifndef OPERATINGSYSTEMSCLASS_PARTICLESIM_H
+#define OPERATINGSYSTEMSCLASS_PARTICLESIM_H
+
+#include <cstdint>
+#include <span>
+#include <thread>
+#include "CollisionSolver.h"
+#include "ForceFields.h"
+#include "InteractionTools.h"
+#include "ParticleArrays.h"
+#include "ThreadPool.h"
+#include "TiledStepper.h"
+
+/*
+ * Public stepping API of the particlesim library: a world owns the particles, the
+ * solver, the force stage and the worker pool.
+ *  -> create a world from a SolverConfig
+ *  -> add particles
+ *  -> step
+ *  -> read the state through spans over the SoA arrays, no copies
+ *
+ * Spans stay valid until particles are added, like iterators of a vector.
+ */
+class ParticleWorld {
+public:
+    explicit ParticleWorld(const SolverConfig& config,
+                           unsigned threads = std::max(1u, std::thread::hardware_concurrency()));
+
+    void setConfig(const SolverConfig& config);
+    [[nodiscard]] const SolverConfig& config() const { return solver.getConfig(); }
+
+    uint32_t addParticle(float x, float y, float vx, float vy);
+    void addParticles(std::span<const float> x, std::span<const float> y,
+                      std::span<const float> vx, std::span<const float> vy);
+    void addParticles(const ParticleArrays& particles);
+
+    // Runs the force stage then the solver, steps times
+    void step(uint32_t steps = 1);
+    // The same, handing every particle to onRegion as soon as the last step is done with it
+    void step(uint32_t steps, const RegionFn& onRegion);
+    // Steps in blocks of tiling.substeps, all but the last step of a block run tile by tile
+    void setTiling(const TilingConfig& config) { tiling = config; }
+    [[nodiscard]] const TilingConfig& tilingConfig() const { return tiling; }
+    void applyTool(const ToolAction& tool);
+    // Runs steps on a copy of the state and puts it back, so every scratch buffer of the
+    // solver, the tiles and the force stage has grown to its working size before a
+    // real-time loop starts (and mlockall can fault it in)
+    void prefault(uint32_t steps = 8);
+
+    [[nodiscard]] size_t size() const { return state.size(); }
+    [[nodiscard]] uint64_t frame() const { return frameIndex; }
+    // Contacting pairs resolved by the last step
+    [[nodiscard]] size_t contactCount() const { return solver.lastContactCount(); }
+
+    [[nodiscard]] std::span<const float> x() const { return state.x; }
+    [[nodiscard]] std::span<const float> y() const { return state.y; }
+    [[nodiscard]] std::span<const float> vx() const { return state.vx; }
+    [[nodiscard]] std::span<const float> vy() const { return state.vy; }
+    // Writable, summed into the velocity by the next step
+    [[nodiscard]] std::span<float> fx() { return state.fx; }
+    [[nodiscard]] std::span<float> fy() { return state.fy; }
+
+    [[nodiscard]] const ParticleArrays& arrays() const { return state; }
+    [[nodiscard]] ParticleArrays& arrays() { return state; }
+    [[nodiscard]] ForceStage& forces() { return forceStage; }
+    [[nodiscard]] ThreadPool& threads() { return pool; }
+    [[nodiscard]] const CollisionSolver& collisionSolver() const { return solver; }
+
+private:
+    ParticleArrays state;
+    CollisionSolver solver;
+    ForceStage forceStage;
+    ThreadPool pool;
+    TilingConfig tiling;
+    TiledStepper tiles;
+    uint64_t frameIndex{};
+};
+
+#endif //OPERATINGSYSTEMSCLASS_PARTICLESIM_H
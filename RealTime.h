@@ -0,0 +1,241 @@
+#ifndef OPERATINGSYSTEMSCLASS_REALTIME_H
+#define OPERATINGSYSTEMSCLASS_REALTIME_H
+
+#include <malloc.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <atomic>
+#include <charconv>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <utility>
+#include <string_view>
+#include <vector>
+#include "IdleWait.h"
+#include "ParticleSim.h"
+
+/*
+ * Opt-in real-time mode for a world's stepping, so a step never waits on the pager
+ * or on a lower priority thread:
+ *  -> prefault: a few dry steps grow every scratch buffer to its working size
+ *  -> mlockall: everything mapped now or later stays resident, faulted in up front
+ *  -> every pool thread, the caller included, touches its stack, moves to its core
+ *     and switches to SCHED_FIFO
+ *
+ * Only the pool's own threads are set up, so the pool backend is forced. Needs
+ * CAP_SYS_NICE and CAP_IPC_LOCK (or matching RLIMIT_RTPRIO and RLIMIT_MEMLOCK);
+ * without them enterRealTime reports why, undoes what it had changed and returns
+ * false.
+ *
+ * JitterStats then records how long steps take and how late the stepping thread
+ * woke up, and answers whether the p99.9 step is within budget from the exact count
+ * of steps over it, not from the histogram's rounded buckets.
+ */
+struct RealTimeConfig {
+    int priority = 80; // SCHED_FIFO, 1 to 99
+    // Pool worker w runs on cores[w % cores.size()]; empty leaves the affinity alone
+    std::vector<int> cores;
+    std::chrono::nanoseconds budget = std::chrono::nanoseconds(16'666'667); // one 60 Hz frame
+    uint32_t warmupSteps = 8;
+};
+
+// "2,3,6-7"; "any" for no pinning
+inline std::optional<std::vector<int>> parseCores(std::string_view list) {
+    std::vector<int> cores;
+    if (list == "any") return cores;
+    auto number = [](std::string_view text, int& out) {
+        auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), out);
+        return error == std::errc() && end == text.data() + text.size();
+    };
+    while (!list.empty()) {
+        const size_t comma = list.find(',');
+        const std::string_view item = list.substr(0, comma);
+        list = comma == std::string_view::npos ? std::string_view() : list.substr(comma + 1);
+        // "2," would otherwise end the loop with the empty item unread
+        if (comma != std::string_view::npos && list.empty()) return std::nullopt;
+        const size_t dash = item.find('-');
+        int first, last;
+        if (!number(item.substr(0, dash), first)) return std::nullopt;
+        last = first;
+        if (dash != std::string_view::npos && !number(item.substr(dash + 1), last)) return std::nullopt;
+        if (first < 0 || last < first || last >= CPU_SETSIZE) return std::nullopt;
+        for (int core = first; core <= last; core++) cores.push_back(core);
+    }
+    if (cores.empty()) return std::nullopt;
+    return cores;
+}
+
+// Touches the next bytes of the calling thread's stack so later calls do not fault
+inline void prefaultStack() {
+    constexpr size_t STACK_PREFAULT = 256 * 1024;
+    uint8_t stack[STACK_PREFAULT];
+    std::memset(stack, 0, sizeof(stack));
+    // Keeps the compiler from dropping the writes to a buffer nobody reads
+    asm volatile("" : : "r"(stack) : "memory");
+}
+
+// glibc's defaults, put back when real-time mode cannot be entered
+constexpr int DEFAULT_TRIM_THRESHOLD = 128 * 1024;
+constexpr int DEFAULT_MMAP_MAX = 65536;
+
+// A pool thread's affinity and scheduling from before enterRealTime changed them
+struct SavedThread {
+    cpu_set_t affinity{};
+    bool affinitySaved = false;
+    int policy = SCHED_OTHER;
+    sched_param param{};
+};
+
+inline bool enterRealTime(ParticleWorld& world, const RealTimeConfig& config) {
+    ThreadPool& pool = world.threads();
+    const ParallelBackend backend = pool.getBackend();
+    const IdlePolicy idle = pool.idlePolicy();
+    std::vector<SavedThread> saved(pool.size());
+    // Puts back whatever was changed before the failure, workers included
+    auto undo = [&](bool locked, bool threads) {
+        if (threads) {
+            pool.forEachWorker([&](unsigned worker) {
+                const SavedThread& thread = saved[worker];
+                if (thread.affinitySaved) pthread_setaffinity_np(pthread_self(), sizeof(thread.affinity), &thread.affinity);
+                pthread_setschedparam(pthread_self(), thread.policy, &thread.param);
+            });
+        }
+        if (locked) munlockall();
+#ifdef __GLIBC__
+        mallopt(M_TRIM_THRESHOLD, DEFAULT_TRIM_THRESHOLD);
+        mallopt(M_MMAP_MAX, DEFAULT_MMAP_MAX);
+#endif
+        pool.setIdlePolicy(idle);
+        pool.setBackend(backend);
+    };
+
+    pool.setBackend(ParallelBackend::Pool);
+    // A FIFO thread spinning on a core another FIFO thread of the pool needs never lets it run
+    if (pool.idlePolicy().strategy == IdleStrategy::Spin && config.cores.size() < pool.size()) {
+        pool.setIdlePolicy({IdleStrategy::Sleep, pool.idlePolicy().spinWindow});
+    }
+
+#ifdef __GLIBC__
+    // Freed memory stays in the heap, so allocating it again does not fault
+    mallopt(M_TRIM_THRESHOLD, -1);
+    mallopt(M_MMAP_MAX, 0);
+#endif
+    world.prefault(config.warmupSteps);
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+        std::cout << "ERROR::REALTIME::MLOCKALL_FAILED\n" << std::strerror(errno) << std::endl;
+        undo(false, false);
+        return false;
+    }
+
+    std::atomic<int> affinityError = 0, scheduleError = 0;
+    pool.forEachWorker([&](unsigned worker) {
+        prefaultStack();
+        SavedThread& thread = saved[worker];
+        thread.affinitySaved = pthread_getaffinity_np(pthread_self(), sizeof(thread.affinity), &thread.affinity) == 0;
+        pthread_getschedparam(pthread_self(), &thread.policy, &thread.param);
+        if (!config.cores.empty()) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(config.cores[worker % config.cores.size()], &set);
+            if (int error = pthread_setaffinity_np(pthread_self(), sizeof(set), &set)) affinityError = error;
+        }
+        sched_param param{};
+        param.sched_priority = config.priority;
+        if (int error = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param)) scheduleError = error;
+    });
+    if (affinityError) {
+        std::cout << "ERROR::REALTIME::AFFINITY_FAILED\n" << std::strerror(affinityError) << std::endl;
+        undo(true, true);
+        return false;
+    }
+    if (scheduleError) {
+        std::cout << "ERROR::REALTIME::SCHED_FIFO_FAILED\n" << std::strerror(scheduleError) << std::endl;
+        undo(true, true);
+        return false;
+    }
+    return true;
+}
+
+struct JitterStats {
+    WaitHistogram step; // step durations
+    WaitHistogram wake; // how late the stepping thread woke against its schedule
+    uint64_t budget{};  // nanoseconds
+    uint64_t overBudget{}, worstStep{}, worstWake{};
+
+    explicit JitterStats(std::chrono::nanoseconds budget) : budget(uint64_t(budget.count())) {}
+
+    void addStep(uint64_t nanoseconds) {
+        step.add(nanoseconds);
+        worstStep = std::max(worstStep, nanoseconds);
+        if (nanoseconds > budget) overBudget++;
+    }
+
+    void addWake(uint64_t nanoseconds) {
+        wake.add(nanoseconds);
+        worstWake = std::max(worstWake, nanoseconds);
+    }
+
+    // Exact: the step at percentile's rank is within budget iff few enough steps are over it
+    [[nodiscard]] bool withinBudget(double p = 0.999) const {
+        const uint64_t all = step.total();
+        if (all == 0) return true;
+        const auto rank = uint64_t(p * double(all - 1));
+        return overBudget <= all - 1 - rank;
+    }
+
+    // Percentiles are bucket upper edges, capped by the worst sample where it is known, so
+    // each is an upper bound on the true value
+    void print(std::ostream& out, const WaitHistogram& poolWake) const {
+        constexpr uint64_t UNKNOWN = UINT64_MAX;
+        auto line = [&](const char* name, const WaitHistogram& histogram, uint64_t worst) {
+            out << "  " << name << std::fixed << std::setprecision(3);
+            for (auto [label, p] : {std::pair{"p50", 0.5}, {"p99", 0.99}, {"p99.9", 0.999}}) {
+                out << "   " << label << " <= " << milliseconds(std::min(histogram.percentile(p), worst)) << " ms";
+            }
+            if (worst != UNKNOWN) out << "   worst " << milliseconds(worst) << " ms";
+            out << std::defaultfloat << "\n";
+        };
+        line("step     ", step, worstStep);
+        line("late wake", wake, worstWake);
+        line("pool wake", poolWake, UNKNOWN);
+        out << "  " << overBudget << " of " << step.total() << " steps over " << milliseconds(budget)
+            << " ms, p99.9 " << (withinBudget() ? "within" : "OVER") << " budget" << std::endl;
+    }
+
+private:
+    static double milliseconds(uint64_t nanoseconds) { return double(nanoseconds) * 1e-6; }
+};
+
+/*
+ * Steps once every period on an absolute schedule, the way a real-time loop would:
+ * sleep until the next tick with clock_nanosleep, record how late the wake-up was,
+ * step, record the step. A step overrunning its period makes the next one start late
+ * rather than skipping ticks, so overruns show up in the wake histogram too.
+ */
+inline void runPeriodic(ParticleWorld& world, std::chrono::nanoseconds period, uint32_t steps, JitterStats& stats) {
+    auto nanoseconds = [](const timespec& t) { return uint64_t(t.tv_sec) * 1'000'000'000 + uint64_t(t.tv_nsec); };
+    timespec next{};
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    for (uint32_t s = 0; s < steps; s++) {
+        const uint64_t target = nanoseconds(next) + uint64_t(period.count());
+        next.tv_sec = time_t(target / 1'000'000'000);
+        next.tv_nsec = long(target % 1'000'000'000);
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, nullptr) == EINTR) {}
+
+        timespec woke{}, done{};
+        clock_gettime(CLOCK_MONOTONIC, &woke);
+        stats.addWake(nanoseconds(woke) - std::min(nanoseconds(woke), target));
+        world.step();
+        clock_gettime(CLOCK_MONOTONIC, &done);
+        stats.addStep(nanoseconds(done) - nanoseconds(woke));
+    }
+}
+
+#endif //OPERATINGSYSTEMSCLASS_REALTIME_H
@@ -0,0 +1,95 @@
+#ifndef OPERATINGSYSTEMSCLASS_SCALAR_H
+#define OPERATINGSYSTEMSCLASS_SCALAR_H
+
+#include <cmath>
+#include <compare>
+#include <cstdint>
+#include <type_traits>
+#include "ParallelPrimitives.h"
+
+/*
+ * Number types the solver runs on, picked as BasicCollisionSolver's template argument:
+ *  -> float, the default and the fastest, twice as many SIMD lanes as double
+ *  -> double, for big worlds: float keeps positions 10^6 from the origin only to 1/16
+ *  -> Fixed32, fixed point in an int32 with 12 fraction bits: everything the solver does
+ *     with it is integer arithmetic, and integer sums do not depend on their order, so
+ *     a run gives the same bits on every machine, compiler, thread count and broad
+ *     phase. Positions have to stay within +-2^19, in steps of 1/4096.
+ */
+struct Fixed32 {
+    static constexpr int FRACTION_BITS = 12;
+    static constexpr int32_t ONE = int32_t(1) << FRACTION_BITS;
+
+    int32_t raw = 0;
+
+    constexpr Fixed32() = default;
+    // Rounds to the nearest step; only meant for setting a run up, not inside one
+    explicit Fixed32(double value) : raw(int32_t(std::llround(value * ONE))) {}
+
+    static constexpr Fixed32 fromRaw(int32_t raw) {
+        Fixed32 f;
+        f.raw = raw;
+        return f;
+    }
+
+    explicit operator float() const { return float(raw) * (1.0f / ONE); }
+    explicit operator double() const { return double(raw) * (1.0 / ONE); }
+
+    // Wrapping like the hardware does, without signed overflow
+    friend constexpr Fixed32 operator+(Fixed32 a, Fixed32 b) { return fromRaw(int32_t(uint32_t(a.raw) + uint32_t(b.raw))); }
+    friend constexpr Fixed32 operator-(Fixed32 a, Fixed32 b) { return fromRaw(int32_t(uint32_t(a.raw) - uint32_t(b.raw))); }
+    friend constexpr Fixed32 operator-(Fixed32 a) { return fromRaw(int32_t(0u - uint32_t(a.raw))); }
+    friend constexpr Fixed32 operator*(Fixed32 a, Fixed32 b) {
+        return fromRaw(int32_t((int64_t(a.raw) * b.raw) >> FRACTION_BITS));
+    }
+    friend constexpr Fixed32 operator/(Fixed32 a, Fixed32 b) {
+        return fromRaw(int32_t((int64_t(a.raw) << FRACTION_BITS) / b.raw));
+    }
+    constexpr Fixed32& operator+=(Fixed32 b) { return *this = *this + b; }
+    constexpr Fixed32& operator-=(Fixed32 b) { return *this = *this - b; }
+
+    friend constexpr auto operator<=>(Fixed32, Fixed32) = default;
+};
+
+// The SIMD kernels load Fixed32 arrays as int32 arrays
+static_assert(sizeof(Fixed32) == sizeof(int32_t) && std::is_standard_layout_v<Fixed32>);
+
+template<class S>
+constexpr const char* scalarName() {
+    if constexpr (std::is_same_v<S, float>) return "float";
+    else if constexpr (std::is_same_v<S, double>) return "double";
+    else return "fixed";
+}
+
+// What the grids compute cell indices in: double for double worlds, float for the others
+template<class S>
+using CellScalar = std::conditional_t<std::is_same_v<S, double>, double, float>;
+
+// p moved into [0, extent) by whole periods
+template<class S> requires std::is_floating_point_v<S>
+S wrapPeriodic(S p, S extent) {
+    p -= extent * std::floor(p / extent);
+    // floor can round p up to exactly extent for tiny negative inputs
+    if (p >= extent) p = S(0);
+    return p;
+}
+
+inline Fixed32 wrapPeriodic(Fixed32 p, Fixed32 extent) {
+    int32_t r = p.raw % extent.raw;
+    return Fixed32::fromRaw(r < 0 ? r + extent.raw : r);
+}
+
+// Unsigned integer ordered like the scalar, for radix sorting by it
+inline uint32_t radixKey(float f) { return floatSortKey(f); }
+inline uint64_t radixKey(double d) { return floatSortKey(d); }
+inline uint32_t radixKey(Fixed32 f) { return uint32_t(f.raw) ^ 0x80000000u; }
+
+// floor(sqrt(n)) for n >= 0, exact: the double estimate is corrected in integers
+inline int64_t integerSqrt(int64_t n) {
+    auto r = int64_t(std::sqrt(double(n)));
+    while (r * r > n) r--;
+    while ((r + 1) * (r + 1) <= n) r++;
+    return r;
+}
+
+#endif //OPERATINGSYSTEMSCLASS_SCALAR_H
@@ -0,0 +1,237 @@
+#ifndef OPERATINGSYSTEMSCLASS_SHAREDSTATE_H
+#define OPERATINGSYSTEMSCLASS_SHAREDSTATE_H
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <atomic>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <cstdint>
+#include <iostream>
+#include <new>
+#include <optional>
+#include <string>
+#include "ParticleArrays.h"
+
+/*
+ * Completed frames published into a POSIX shared memory object, so viewers,
+ * analysis tools and recorders in other processes can read the particle state.
+ *
+ * The object holds a header followed by SLOT_COUNT slots used as a ring. Every
+ * slot is a seqlock protected header plus SoA arrays (x, y, vx, vy) sized for the
+ * capacity given at creation:
+ *
+ *  writer -> sequence becomes odd -> copy arrays -> sequence becomes even
+ *         -> header.latestFrame = frame
+ *  reader -> read latestFrame -> read slot sequence (retry while odd)
+ *         -> use the arrays in place -> sequence unchanged? the data was consistent
+ *
+ * Readers map the object read only and never write to it, so any number of them
+ * can attach and none can hold the writer up. With several slots a reader has
+ * SLOT_COUNT - 1 frames of time before the slot it is looking at gets reused.
+ */
+struct SharedStateLayout {
+    static constexpr uint32_t MAGIC = 0x54535053; // "SPST"
+    static constexpr uint32_t VERSION = 1;
+    static constexpr uint32_t SLOT_COUNT = 4;
+    static constexpr size_t ALIGN = 64;
+
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t slotCount;
+        uint32_t capacity;
+        uint64_t slotBytes;
+        std::atomic<uint64_t> latestFrame;
+        // Particles left out of the last frame because the object was too small
+        std::atomic<uint32_t> dropped;
+    };
+
+    struct SlotHeader {
+        std::atomic<uint64_t> sequence;
+        uint64_t frame;
+        uint32_t count;
+    };
+
+    static size_t alignUp(size_t bytes) { return (bytes + ALIGN - 1) / ALIGN * ALIGN; }
+    static size_t arrayBytes(uint32_t capacity) { return alignUp(capacity * sizeof(float)); }
+    static size_t slotBytes(uint32_t capacity) { return alignUp(sizeof(SlotHeader)) + 4 * arrayBytes(capacity); }
+    static size_t headerBytes() { return alignUp(sizeof(Header)); }
+    static size_t totalBytes(uint32_t capacity) { return headerBytes() + SLOT_COUNT * slotBytes(capacity); }
+
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "seqlock needs address free atomics");
+};
+
+// Zero copy view of one published frame, valid while the slot's sequence is unchanged
+struct SharedFrame {
+    uint32_t slot{};
+    uint64_t frame{};
+    uint64_t sequence{};
+    uint32_t count{};
+    const float *x{}, *y{}, *vx{}, *vy{};
+};
+
+class StatePublisher {
+public:
+    StatePublisher(std::string name, uint32_t capacity) : name(std::move(name)), capacity(capacity) {
+        int fd = shm_open(this->name.c_str(), O_CREAT | O_RDWR, 0644);
+        if (fd < 0) fail("SHM_OPEN_FAILED");
+        bytes = SharedStateLayout::totalBytes(capacity);
+        if (ftruncate(fd, off_t(bytes)) != 0) fail("TRUNCATE_FAILED");
+        void* mapped = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (mapped == MAP_FAILED) fail("MMAP_FAILED");
+        base = static_cast<uint8_t*>(mapped);
+
+        for (uint32_t s = 0; s < SharedStateLayout::SLOT_COUNT; s++) {
+            new (base + slotOffset(s)) SharedStateLayout::SlotHeader{{0}, 0, 0};
+        }
+        // magic goes last, readers attaching early see an uninitialised object and retry
+        auto* header = new (base) SharedStateLayout::Header{0, SharedStateLayout::VERSION,
+                                                            SharedStateLayout::SLOT_COUNT, capacity,
+                                                            SharedStateLayout::slotBytes(capacity), {0}, {0}};
+        std::atomic_ref<uint32_t>(header->magic).store(SharedStateLayout::MAGIC, std::memory_order_release);
+    }
+
+    ~StatePublisher() {
+        munmap(base, bytes);
+        shm_unlink(name.c_str());
+    }
+
+    StatePublisher(const StatePublisher&) = delete;
+    StatePublisher& operator=(const StatePublisher&) = delete;
+
+    void publish(const ParticleArrays& state, uint64_t frame) {
+        auto* header = reinterpret_cast<SharedStateLayout::Header*>(base);
+        uint8_t* slot = base + slotOffset(uint32_t(frame % SharedStateLayout::SLOT_COUNT));
+        auto* slotHeader = reinterpret_cast<SharedStateLayout::SlotHeader*>(slot);
+        const auto count = uint32_t(std::min<size_t>(state.size(), capacity));
+
+        uint64_t sequence = slotHeader->sequence.load(std::memory_order_relaxed);
+        slotHeader->sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        slotHeader->frame = frame;
+        slotHeader->count = count;
+        float* arrays[4];
+        slotArrays(slot, capacity, arrays);
+        std::memcpy(arrays[0], state.x.data(), count * sizeof(float));
+        std::memcpy(arrays[1], state.y.data(), count * sizeof(float));
+        std::memcpy(arrays[2], state.vx.data(), count * sizeof(float));
+        std::memcpy(arrays[3], state.vy.data(), count * sizeof(float));
+
+        slotHeader->sequence.store(sequence + 2, std::memory_order_release);
+        header->dropped.store(uint32_t(state.size() - count), std::memory_order_relaxed);
+        header->latestFrame.store(frame, std::memory_order_release);
+    }
+
+private:
+    [[nodiscard]] size_t slotOffset(uint32_t slot) const {
+        return SharedStateLayout::headerBytes() + slot * SharedStateLayout::slotBytes(capacity);
+    }
+
+    friend class StateReader;
+
+    static void slotArrays(uint8_t* slot, uint32_t capacity, float* arrays[4]) {
+        uint8_t* first = slot + SharedStateLayout::alignUp(sizeof(SharedStateLayout::SlotHeader));
+        for (int a = 0; a < 4; a++) {
+            arrays[a] = reinterpret_cast<float*>(first + a * SharedStateLayout::arrayBytes(capacity));
+        }
+    }
+
+    static void fail(const char* what) {
+        std::cout << "ERROR::STATEPUBLISHER::" << what << "\n" << std::strerror(errno) << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    std::string name;
+    uint32_t capacity;
+    size_t bytes{};
+    uint8_t* base{};
+};
+
+class StateReader {
+public:
+    // Returns false while the object does not exist yet or is still being set up
+    bool attach(const std::string& name) {
+        detach();
+        int fd = shm_open(name.c_str(), O_RDONLY, 0);
+        if (fd < 0) return false;
+        struct stat info{};
+        if (fstat(fd, &info) != 0 || size_t(info.st_size) < SharedStateLayout::headerBytes()) {
+            close(fd);
+            return false;
+        }
+        void* mapped = mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (mapped == MAP_FAILED) return false;
+        base = static_cast<const uint8_t*>(mapped);
+        bytes = size_t(info.st_size);
+
+        auto* header = reinterpret_cast<const SharedStateLayout::Header*>(base);
+        uint32_t magic = std::atomic_ref<uint32_t>(const_cast<uint32_t&>(header->magic)).load(std::memory_order_acquire);
+        if (magic != SharedStateLayout::MAGIC || header->version != SharedStateLayout::VERSION ||
+            bytes < SharedStateLayout::totalBytes(header->capacity)) {
+            detach();
+            return false;
+        }
+        return true;
+    }
+
+    void detach() {
+        if (base) munmap(const_cast<uint8_t*>(base), bytes);
+        base = nullptr;
+    }
+
+    ~StateReader() { detach(); }
+
+    // Newest complete frame, or nothing if the writer kept overwriting it while we looked
+    [[nodiscard]] std::optional<SharedFrame> latest(int attempts = 8) const {
+        auto* header = reinterpret_cast<const SharedStateLayout::Header*>(base);
+        for (int attempt = 0; attempt < attempts; attempt++) {
+            uint64_t frame = header->latestFrame.load(std::memory_order_acquire);
+            SharedFrame view;
+            view.slot = uint32_t(frame % header->slotCount);
+            const uint8_t* slot = base + slotOffset(view.slot);
+            auto* slotHeader = reinterpret_cast<const SharedStateLayout::SlotHeader*>(slot);
+
+            view.sequence = slotHeader->sequence.load(std::memory_order_acquire);
+            if (view.sequence & 1) continue;
+            view.frame = slotHeader->frame;
+            view.count = std::min(slotHeader->count, header->capacity);
+            float* arrays[4];
+            StatePublisher::slotArrays(const_cast<uint8_t*>(slot), header->capacity, arrays);
+            view.x = arrays[0];
+            view.y = arrays[1];
+            view.vx = arrays[2];
+            view.vy = arrays[3];
+            if (stillValid(view)) return view;
+        }
+        return std::nullopt;
+    }
+
+    // Call after using a frame's arrays: false means the writer reused the slot meanwhile
+    [[nodiscard]] bool stillValid(const SharedFrame& view) const {
+        auto* slotHeader = reinterpret_cast<const SharedStateLayout::SlotHeader*>(base + slotOffset(view.slot));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return slotHeader->sequence.load(std::memory_order_relaxed) == view.sequence;
+    }
+
+    [[nodiscard]] uint32_t capacity() const {
+        return reinterpret_cast<const SharedStateLayout::Header*>(base)->capacity;
+    }
+
+private:
+    [[nodiscard]] size_t slotOffset(uint32_t slot) const {
+        auto* header = reinterpret_cast<const SharedStateLayout::Header*>(base);
+        return SharedStateLayout::headerBytes() + slot * header->slotBytes;
+    }
+
+    const uint8_t* base{};
+    size_t bytes{};
+};
+
+#endif //OPERATINGSYSTEMSCLASS_SHAREDSTATE_H
@@ -0,0 +1,345 @@
+#ifndef OPERATINGSYSTEMSCLASS_SPATIALQUERY_H
+#define OPERATINGSYSTEMSCLASS_SPATIALQUERY_H
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <utility>
+#include <vector>
+#include "CollisionSolver.h"
+#include "ThreadPool.h"
+
+struct PointQuery {
+    float x, y;
+};
+
+struct RadiusQuery {
+    float x, y, radius;
+};
+
+struct BoxQuery {
+    float minX, minY, maxX, maxY;
+};
+
+struct RayQuery {
+    float x, y;
+    float dirX, dirY; // need not be normalised
+    float maxDistance;
+};
+
+struct RayHit {
+    static constexpr uint32_t NONE = ~0u;
+    uint32_t particle = NONE;
+    float distance = std::numeric_limits<float>::infinity();
+};
+
+// Results of a batch of radius or box queries: query q found particles[offsets[q]..offsets[q + 1])
+struct QueryResults {
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> particles;
+};
+
+/*
+ * Immutable copy of the particle positions of one frame plus the grid the solver
+ * would build over them (same grid type and cell size as the SolverConfig). The
+ * grid is built by whichever query touches the snapshot first, never by the
+ * simulation thread. Particle ids are indices into the arrays at publish time.
+ *
+ * Queries work in plain world coordinates: they do not wrap around periodic axes.
+ */
+class SpatialSnapshot {
+public:
+    uint64_t frame{};
+    SolverConfig config{};
+    std::vector<float> x, y;
+
+    // Appends the particles within r of (qx, qy) to out
+    void radius(float qx, float qy, float r, std::vector<uint32_t>& out) const {
+        ensureIndex();
+        withGrid([&](auto& grid) {
+            const float r2 = r * r;
+            grid.forEachCellSpanIn(grid.cellX(qx - r), grid.cellY(qy - r), grid.cellX(qx + r), grid.cellY(qy + r),
+                                   [&](uint32_t begin, uint32_t end) {
+                for (uint32_t s = begin; s < end; s++) {
+                    float dx = grid.slotX[s] - qx, dy = grid.slotY[s] - qy;
+                    if (dx * dx + dy * dy <= r2) out.push_back(grid.slotParticle[s]);
+                }
+            });
+        });
+    }
+
+    // Appends the particles inside the box, edges included, to out
+    void box(const BoxQuery& q, std::vector<uint32_t>& out) const {
+        ensureIndex();
+        withGrid([&](auto& grid) {
+            grid.forEachCellSpanIn(grid.cellX(q.minX), grid.cellY(q.minY), grid.cellX(q.maxX), grid.cellY(q.maxY),
+                                   [&](uint32_t begin, uint32_t end) {
+                for (uint32_t s = begin; s < end; s++) {
+                    float px = grid.slotX[s], py = grid.slotY[s];
+                    if (px >= q.minX && px <= q.maxX && py >= q.minY && py <= q.maxY) {
+                        out.push_back(grid.slotParticle[s]);
+                    }
+                }
+            });
+        });
+    }
+
+    /*
+     * k nearest particles, closest first, searched ring by ring of cells around the
+     * query. After ring r every unvisited particle is at least r cells away, so the
+     * search stops once the k-th candidate is closer than that.
+     */
+    void nearest(float qx, float qy, uint32_t k, std::vector<uint32_t>& out) const {
+        ensureIndex();
+        out.clear();
+        if (k == 0) return;
+        withGrid([&](auto& grid) {
+            std::vector<std::pair<float, uint32_t>> heap;
+            heap.reserve(k + 1);
+            auto visit = [&](uint32_t begin, uint32_t end) {
+                for (uint32_t s = begin; s < end; s++) {
+                    float dx = grid.slotX[s] - qx, dy = grid.slotY[s] - qy;
+                    float d2 = dx * dx + dy * dy;
+                    if (heap.size() == k && d2 >= heap.front().first) continue;
+                    heap.emplace_back(d2, grid.slotParticle[s]);
+                    std::push_heap(heap.begin(), heap.end());
+                    if (heap.size() > k) {
+                        std::pop_heap(heap.begin(), heap.end());
+                        heap.pop_back();
+                    }
+                }
+            };
+
+            const CellBounds b = grid.cellBounds();
+            if (b.minX > b.maxX || b.minY > b.maxY) return;
+            const int64_t cx = grid.cellX(qx), cy = grid.cellY(qy);
+            const float cellMin = std::min(1.0f / grid.invCellX, 1.0f / grid.invCellY);
+            int64_t r = std::max({int64_t(0), b.minX - cx, cx - b.maxX, b.minY - cy, cy - b.maxY});
+            for (;; r++) {
+                if (r == 0) {
+                    grid.forEachCellSpanIn(cx, cy, cx, cy, visit);
+                } else {
+                    grid.forEachCellSpanIn(cx - r, cy - r, cx + r, cy - r, visit);
+                    grid.forEachCellSpanIn(cx - r, cy + r, cx + r, cy + r, visit);
+                    grid.forEachCellSpanIn(cx - r, cy - r + 1, cx - r, cy + r - 1, visit);
+                    grid.forEachCellSpanIn(cx + r, cy - r + 1, cx + r, cy + r - 1, visit);
+                }
+                float reach = float(r) * cellMin;
+                if (heap.size() == k && heap.front().first <= reach * reach) break;
+                if (cx - r <= b.minX && cx + r >= b.maxX && cy - r <= b.minY && cy + r >= b.maxY) break;
+            }
+
+            std::sort_heap(heap.begin(), heap.end());
+            for (auto& candidate : heap) out.push_back(candidate.second);
+        });
+    }
+
+    /*
+     * First particle, drawn as a disc of particleRadius, hit by the ray. Cells are
+     * walked front to back (Amanatides & Woo) and every cell tests the discs whose
+     * centre lies within reach cells of it. A hit closer than the exit of the current
+     * cell can not be beaten by anything further along, so the walk stops there.
+     */
+    [[nodiscard]] RayHit raycast(const RayQuery& q, float particleRadius) const {
+        ensureIndex();
+        RayHit hit;
+        float length = std::sqrt(q.dirX * q.dirX + q.dirY * q.dirY);
+        if (!(length > 0.0f)) return hit;
+        const float dx = q.dirX / length, dy = q.dirY / length;
+
+        withGrid([&](auto& grid) {
+            const CellBounds b = grid.cellBounds();
+            if (b.minX > b.maxX || b.minY > b.maxY) return;
+            const float cellW = 1.0f / grid.invCellX, cellH = 1.0f / grid.invCellY;
+            const auto reach = int64_t(std::ceil(particleRadius * std::max(grid.invCellX, grid.invCellY)));
+
+            // Clip the ray to the occupied cells grown by reach, nothing outside can be hit
+            float t0 = 0.0f, t1 = q.maxDistance;
+            auto clip = [&](float origin, float dir, float low, float high) {
+                if (dir == 0.0f) return origin >= low && origin <= high;
+                float a = (low - origin) / dir, c = (high - origin) / dir;
+                t0 = std::max(t0, std::min(a, c));
+                t1 = std::min(t1, std::max(a, c));
+                return t0 <= t1;
+            };
+            if (!clip(q.x, dx, float(b.minX - reach) * cellW, float(b.maxX + reach + 1) * cellW)) return;
+            if (!clip(q.y, dy, float(b.minY - reach) * cellH, float(b.maxY + reach + 1) * cellH)) return;
+
+            float px = q.x + dx * t0, py = q.y + dy * t0;
+            int64_t cx = grid.cellX(px), cy = grid.cellY(py);
+            const int stepX = dx > 0 ? 1 : -1, stepY = dy > 0 ? 1 : -1;
+            const float inf = std::numeric_limits<float>::infinity();
+            const float deltaX = dx != 0 ? cellW / std::abs(dx) : inf;
+            const float deltaY = dy != 0 ? cellH / std::abs(dy) : inf;
+            float nextX = dx != 0 ? t0 + (float(cx + (stepX > 0)) * cellW - px) / dx : inf;
+            float nextY = dy != 0 ? t0 + (float(cy + (stepY > 0)) * cellH - py) / dy : inf;
+
+            const float r2 = particleRadius * particleRadius;
+            auto test = [&](uint32_t begin, uint32_t end) {
+                for (uint32_t s = begin; s < end; s++) {
+                    float mx = q.x - grid.slotX[s], my = q.y - grid.slotY[s];
+                    float along = mx * dx + my * dy;
+                    float c = mx * mx + my * my - r2;
+                    if (c > 0.0f && along > 0.0f) continue;
+                    float discriminant = along * along - c;
+                    if (discriminant < 0.0f) continue;
+                    float t = std::max(0.0f, -along - std::sqrt(discriminant));
+                    if (t <= q.maxDistance && t < hit.distance) hit = {grid.slotParticle[s], t};
+                }
+            };
+
+            while (true) {
+                grid.forEachCellSpanIn(cx - reach, cy - reach, cx + reach, cy + reach, test);
+                float exit = std::min(nextX, nextY);
+                if (hit.distance <= exit || exit > t1) return;
+                if (nextX < nextY) {
+                    cx += stepX;
+                    nextX += deltaX;
+                } else {
+                    cy += stepY;
+                    nextY += deltaY;
+                }
+            }
+        });
+        return hit;
+    }
+
+    void radiusBatch(std::span<const RadiusQuery> queries, QueryResults& results, ThreadPool& pool) const {
+        collectBatch(queries.size(), results, pool, [&](size_t q, std::vector<uint32_t>& out) {
+            radius(queries[q].x, queries[q].y, queries[q].radius, out);
+        });
+    }
+
+    void boxBatch(std::span<const BoxQuery> queries, QueryResults& results, ThreadPool& pool) const {
+        collectBatch(queries.size(), results, pool, [&](size_t q, std::vector<uint32_t>& out) {
+            box(queries[q], out);
+        });
+    }
+
+    // out holds k ids per query, RayHit::NONE where fewer than k particles exist
+    void nearestBatch(std::span<const PointQuery> points, uint32_t k, std::vector<uint32_t>& out,
+                      ThreadPool& pool) const {
+        ensureIndex();
+        out.assign(points.size() * k, RayHit::NONE);
+        pool.parallelFor(0, points.size(), BATCH_GRAIN, [&](size_t begin, size_t end, unsigned) {
+            std::vector<uint32_t> found;
+            for (size_t q = begin; q < end; q++) {
+                nearest(points[q].x, points[q].y, k, found);
+                std::copy(found.begin(), found.end(), out.begin() + long(q * k));
+            }
+        });
+    }
+
+    void raycastBatch(std::span<const RayQuery> queries, float particleRadius, std::vector<RayHit>& out,
+                      ThreadPool& pool) const {
+        ensureIndex();
+        out.resize(queries.size());
+        pool.parallelFor(0, queries.size(), BATCH_GRAIN, [&](size_t begin, size_t end, unsigned) {
+            for (size_t q = begin; q < end; q++) out[q] = raycast(queries[q], particleRadius);
+        });
+    }
+
+    // Builds the grid now instead of on the first query
+    void ensureIndex() const {
+        if (indexed.load(std::memory_order_acquire)) return;
+        std::lock_guard lock(indexMutex);
+        if (indexed.load(std::memory_order_relaxed)) return;
+        bool periodicX = config.boundaryX == BoundaryMode::Periodic;
+        bool periodicY = config.boundaryY == BoundaryMode::Periodic;
+        if (config.gridMode == GridMode::Dense) {
+            denseGrid.configure(config.width, config.height, config.radius, periodicX, periodicY);
+            denseGrid.build(x.data(), y.data(), x.size());
+        } else {
+            hashedGrid.configure(config.width, config.height, config.radius, periodicX, periodicY);
+            hashedGrid.build(x.data(), y.data(), x.size());
+        }
+        indexed.store(true, std::memory_order_release);
+    }
+
+    // Lets the publisher reuse a snapshot nobody holds anymore
+    void reset() { indexed.store(false, std::memory_order_relaxed); }
+
+private:
+    static constexpr size_t BATCH_GRAIN = 256;
+
+    template<class Fn>
+    void withGrid(Fn&& fn) const {
+        if (config.gridMode == GridMode::Dense) fn(denseGrid);
+        else fn(hashedGrid);
+    }
+
+    // Runs chunks of queries in parallel into per chunk buffers, then packs them
+    template<class Query>
+    void collectBatch(size_t count, QueryResults& results, ThreadPool& pool, Query&& query) const {
+        ensureIndex();
+        results.offsets.assign(count + 1, 0);
+        std::vector<std::vector<uint32_t>> chunks((count + BATCH_GRAIN - 1) / BATCH_GRAIN);
+        pool.parallelFor(0, count, BATCH_GRAIN, [&](size_t begin, size_t end, unsigned) {
+            auto& found = chunks[begin / BATCH_GRAIN];
+            for (size_t q = begin; q < end; q++) {
+                size_t before = found.size();
+                query(q, found);
+                results.offsets[q + 1] = uint32_t(found.size() - before);
+            }
+        });
+        for (size_t q = 0; q < count; q++) results.offsets[q + 1] += results.offsets[q];
+        results.particles.resize(results.offsets[count]);
+        auto write = results.particles.begin();
+        for (auto& found : chunks) write = std::copy(found.begin(), found.end(), write);
+    }
+
+    mutable std::mutex indexMutex;
+    mutable std::atomic<bool> indexed{false};
+    mutable UniformGrid denseGrid;
+    mutable HashedGrid hashedGrid;
+};
+
+/*
+ * Hands the newest snapshot to any number of query threads. publish() only copies
+ * the positions; readers keep the snapshot they loaded alive through the
+ * shared_ptr, so a frame never changes under a running query.
+ *
+ * A snapshot's memory is reused once its last reader lets go: the shared_ptr's deleter
+ * hands it back under a mutex, which orders that reader's last reads before publish()
+ * overwrites the positions. The spares outlive the publisher while readers remain.
+ */
+class SpatialQueries {
+public:
+    void publish(const ParticleArrays& state, const SolverConfig& config, uint64_t frame) {
+        std::unique_ptr<SpatialSnapshot> next;
+        {
+            std::lock_guard lock(spares->mutex);
+            next = std::move(spares->spare);
+        }
+        if (!next) next = std::make_unique<SpatialSnapshot>();
+        next->reset();
+        next->frame = frame;
+        next->config = config;
+        next->x.assign(state.x.begin(), state.x.end());
+        next->y.assign(state.y.begin(), state.y.end());
+        latest.store(std::shared_ptr<const SpatialSnapshot>(next.release(), [spares = spares](const SpatialSnapshot* done) {
+            std::lock_guard lock(spares->mutex);
+            spares->spare.reset(const_cast<SpatialSnapshot*>(done));
+        }));
+    }
+
+    [[nodiscard]] std::shared_ptr<const SpatialSnapshot> snapshot() const {
+        return latest.load();
+    }
+
+private:
+    struct Spares {
+        std::mutex mutex;
+        std::unique_ptr<SpatialSnapshot> spare;
+    };
+
+    std::shared_ptr<Spares> spares = std::make_shared<Spares>();
+    std::atomic<std::shared_ptr<const SpatialSnapshot>> latest;
+};
+
+#endif //OPERATINGSYSTEMSCLASS_SPATIALQUERY_H
@@ -0,0 +1,207 @@
+#ifndef OPERATINGSYSTEMSCLASS_SWEEPANDPRUNE_H
+#define OPERATINGSYSTEMSCLASS_SWEEPANDPRUNE_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <span>
+#include <vector>
+#include "ParallelPrimitives.h"
+#include "Scalar.h"
+#include "ThreadPool.h"
+
+/*
+ * Sort and sweep broad phase, an alternative to the grids for scenes that are much
+ * longer along one axis, like createPoints' rows:
+ *  -> pick the axis along which the particles spread the most (largest variance)
+ *  -> keep the particles sorted along it; between steps they barely move, so an
+ *     insertion sort of last step's order runs in close to linear time, and only
+ *     the first step or a stale order needs a full (radix) sort
+ *  -> a particle only needs testing against the run of particles after it whose
+ *     key is less than one radius larger
+ *
+ * The sorted particles are copied into slots like the grids do, so the solver's
+ * contact pipeline runs unchanged on top. On a periodic sweep axis the runs wrap
+ * past the end of the order, which needs the period to be at least two radii.
+ * Keys are the solver's scalar S, radix sorted through radixKey.
+ */
+template<class S>
+class BasicSweepAndPrune {
+public:
+    void configure(S width, S height, S radius, bool periodicX, bool periodicY) {
+        // A shorter period would let a run wrap onto the particle it started from
+        if ((periodicX && width < radius + radius) || (periodicY && height < radius + radius)) {
+            std::cout << "ERROR::SWEEPANDPRUNE::PERIOD_TOO_SMALL\n" << double(width) << " x " << double(height)
+                      << " needs at least " << 2 * double(radius) << " on a periodic axis" << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        reach = radius;
+        period[0] = periodicX ? width : S(0);
+        period[1] = periodicY ? height : S(0);
+        sorted = false;
+    }
+
+    void build(const S* x, const S* y, size_t count, ThreadPool* pool) {
+        chooseAxis(x, y, count, pool);
+        const S* key = axis == 0 ? x : y;
+
+        bool resort = !sorted || order.size() != count;
+        if (!resort) {
+            // Blocks are sorted in parallel, the final pass only fixes the block seams. A
+            // pass that needs too many shifts means the order went stale, sort from scratch.
+            std::atomic<bool> stale = false;
+            forRange(pool, count, SORT_GRAIN, [&](size_t begin, size_t end) {
+                for (size_t k = begin; k < end; k++) keys[k] = key[order[k]];
+                if (!insertionSort(begin, end, SHIFT_BUDGET * (end - begin))) stale = true;
+            });
+            resort = stale || !insertionSort(0, count, SHIFT_BUDGET * count);
+            lastFull = false;
+        }
+        if (resort) {
+            order.resize(count);
+            sortKeys.resize(count);
+            keys.resize(count);
+            forRange(pool, count, SORT_GRAIN, [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++) {
+                    order[i] = uint32_t(i);
+                    sortKeys[i] = radixKey(key[i]);
+                }
+            });
+            sorter.sort(pool, std::span(sortKeys), std::span(order));
+            forRange(pool, count, SORT_GRAIN, [&](size_t begin, size_t end) {
+                for (size_t k = begin; k < end; k++) keys[k] = key[order[k]];
+            });
+            sorted = true;
+            lastFull = true;
+        }
+
+        slotParticle.resize(count);
+        slotX.resize(count);
+        slotY.resize(count);
+        forRange(pool, count, SORT_GRAIN, [&](size_t begin, size_t end) {
+            for (size_t k = begin; k < end; k++) {
+                slotParticle[k] = order[k];
+                slotX[k] = x[order[k]];
+                slotY[k] = y[order[k]];
+            }
+        });
+    }
+
+    [[nodiscard]] uint32_t pairUnitCount() const { return uint32_t(keys.size()); }
+
+    // Calls fn(a, begin, end) for the slots a in [first, last), so that every pair of slots
+    // closer than the radius along the sweep axis is (a, b) of exactly one call with b in [begin, end)
+    template<class Fn>
+    void forEachPairSpan(uint32_t first, uint32_t last, Fn&& fn) const {
+        if (first >= last) return;
+        const auto count = uint32_t(keys.size());
+        const S p = period[axis];
+        uint32_t end = firstAtLeast(keys[first] + reach, first + 1);
+        for (uint32_t a = first; a < last; a++) {
+            while (end < count && keys[end] < keys[a] + reach) end++;
+            fn(a, a + 1, end);
+            if (p > S(0) && keys[a] + reach > p) {
+                fn(a, 0u, std::min(a, firstAtLeast(keys[a] + reach - p, 0)));
+            }
+        }
+    }
+
+    // Calls fn(begin, end) with the slots whose key is within r of the key of (x, y)
+    template<class Fn>
+    void forEachSpanNear(S x, S y, S r, Fn&& fn) const {
+        const S k = axis == 0 ? x : y, p = period[axis];
+        auto span = [&](S lo, S hi) {
+            uint32_t begin = firstAtLeast(lo, 0), end = firstAbove(hi, begin);
+            if (begin < end) fn(begin, end);
+        };
+        if (p > S(0) && r + r >= p) return span(-r, p + r);
+        span(k - r, k + r);
+        if (p > S(0) && k - r < S(0)) span(k - r + p, p);
+        if (p > S(0) && k + r > p) span(S(0), k + r - p);
+    }
+
+    [[nodiscard]] int sweepAxis() const { return axis; }
+    [[nodiscard]] bool lastBuildWasFull() const { return lastFull; }
+
+    std::vector<uint32_t> slotParticle;
+    std::vector<S> slotX, slotY;
+
+private:
+    static constexpr size_t SORT_GRAIN = 16384;
+    // Average shifts per particle an insertion sort may take before a full sort is cheaper
+    static constexpr size_t SHIFT_BUDGET = 16;
+    // The other axis has to spread this much more before the order is thrown away
+    static constexpr double AXIS_HYSTERESIS = 1.25;
+
+    template<class Fn>
+    static void forRange(ThreadPool* pool, size_t count, size_t grain, Fn&& fn) {
+        if (pool) pool->parallelFor(0, count, grain, [&](size_t b, size_t e, unsigned) { fn(b, e); });
+        else fn(0, count);
+    }
+
+    void chooseAxis(const S* x, const S* y, size_t count, ThreadPool* pool) {
+        struct Moments {
+            double sum[2]{}, squares[2]{};
+        };
+        const Moments m = parallelReduce(pool, count, Moments{}, [&](size_t i) {
+            const double px = double(x[i]), py = double(y[i]);
+            return Moments{{px, py}, {px * px, py * py}};
+        }, [](const Moments& a, const Moments& b) {
+            return Moments{{a.sum[0] + b.sum[0], a.sum[1] + b.sum[1]}, {a.squares[0] + b.squares[0], a.squares[1] + b.squares[1]}};
+        });
+        double n = double(std::max<size_t>(count, 1));
+        double variance[2] = {m.squares[0] / n - (m.sum[0] / n) * (m.sum[0] / n),
+                              m.squares[1] / n - (m.sum[1] / n) * (m.sum[1] / n)};
+        int other = 1 - axis;
+        if (variance[other] > AXIS_HYSTERESIS * variance[axis]) {
+            axis = other;
+            sorted = false;
+        }
+    }
+
+    // Gives up, leaving [begin, end) partly sorted, once more than budget shifts were needed
+    bool insertionSort(size_t begin, size_t end, size_t budget) {
+        size_t shifts = 0;
+        for (size_t k = begin + 1; k < end; k++) {
+            S key = keys[k];
+            if (!(key < keys[k - 1])) continue;
+            uint32_t particle = order[k];
+            size_t j = k;
+            while (j > begin && key < keys[j - 1]) {
+                keys[j] = keys[j - 1];
+                order[j] = order[j - 1];
+                j--;
+            }
+            keys[j] = key;
+            order[j] = particle;
+            shifts += k - j;
+            if (shifts > budget) return false;
+        }
+        return true;
+    }
+
+    [[nodiscard]] uint32_t firstAtLeast(S key, uint32_t from) const {
+        return uint32_t(std::lower_bound(keys.begin() + from, keys.end(), key) - keys.begin());
+    }
+
+    [[nodiscard]] uint32_t firstAbove(S key, uint32_t from) const {
+        return uint32_t(std::upper_bound(keys.begin() + from, keys.end(), key) - keys.begin());
+    }
+
+    using SortKey = decltype(radixKey(S{}));
+
+    S reach{};
+    S period[2]{};
+    int axis = 0;
+    bool sorted = false, lastFull = true;
+    std::vector<uint32_t> order;
+    std::vector<S> keys;
+    // Full sorts only: the keys as radix sortable integers
+    std::vector<SortKey> sortKeys;
+    RadixSorter<SortKey, uint32_t> sorter;
+};
+
+using SweepAndPrune = BasicSweepAndPrune<float>;
+
+#endif //OPERATINGSYSTEMSCLASS_SWEEPANDPRUNE_H
@@ -0,0 +1,95 @@
+#ifndef OPERATINGSYSTEMSCLASS_TASKGRAPH_H
+#define OPERATINGSYSTEMSCLASS_TASKGRAPH_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+#include "ThreadPool.h"
+
+/*
+ * Dependency graph of tasks run on a ThreadPool, instead of one parallel loop after
+ * another with a barrier in between:
+ *  -> add tasks, and edges saying which task has to finish before which
+ *  -> run: every task whose predecessors are done is ready, any idle worker takes it
+ *  -> finishing a task readies the successors that were only waiting for it
+ *
+ * Tasks added with onCaller run on the thread that called run(), for work tied to
+ * it like OpenGL calls; that thread prefers them over the shared ones. Tasks get the
+ * worker index like parallelFor bodies do, and like them must not start a parallelFor
+ * on the same pool. A graph can be run again, or cleared and rebuilt each frame.
+ */
+class TaskGraph {
+public:
+    using Task = uint32_t;
+
+    Task add(std::function<void(unsigned)> fn, bool onCaller = false) {
+        nodes.push_back({std::move(fn), {}, 0, onCaller});
+        return Task(nodes.size() - 1);
+    }
+
+    // after starts only once before has finished
+    void precede(Task before, Task after) {
+        nodes[before].successors.push_back(after);
+        nodes[after].predecessors++;
+    }
+
+    void clear() { nodes.clear(); }
+    [[nodiscard]] size_t size() const { return nodes.size(); }
+
+    void run(ThreadPool& pool) {
+        if (nodes.empty()) return;
+        pending.assign(nodes.size(), 0);
+        ready.clear();
+        callerReady.clear();
+        remaining = nodes.size();
+        for (Task t = 0; t < nodes.size(); t++) {
+            pending[t] = nodes[t].predecessors;
+            if (pending[t] == 0) (nodes[t].onCaller ? callerReady : ready).push_back(t);
+        }
+        // Every worker stays until the whole graph is done; the caller is worker 0
+        pool.forEachWorker([&](unsigned worker) { drain(worker); });
+    }
+
+private:
+    struct Node {
+        std::function<void(unsigned)> fn;
+        std::vector<Task> successors;
+        uint32_t predecessors;
+        bool onCaller;
+    };
+
+    void drain(unsigned worker) {
+        const bool caller = worker == 0;
+        std::unique_lock lock(mutex);
+        while (true) {
+            changed.wait(lock, [&] { return remaining == 0 || !ready.empty() || (caller && !callerReady.empty()); });
+            if (remaining == 0) return;
+            std::vector<Task>& queue = caller && !callerReady.empty() ? callerReady : ready;
+            Task task = queue.back();
+            queue.pop_back();
+
+            lock.unlock();
+            nodes[task].fn(worker);
+            lock.lock();
+
+            bool wakeAll = --remaining == 0;
+            for (Task next : nodes[task].successors) {
+                if (--pending[next] > 0) continue;
+                (nodes[next].onCaller ? callerReady : ready).push_back(next);
+                wakeAll = true;
+            }
+            if (wakeAll) changed.notify_all();
+        }
+    }
+
+    std::vector<Node> nodes;
+    std::vector<uint32_t> pending;
+    std::vector<Task> ready, callerReady;
+    size_t remaining{};
+    std::mutex mutex;
+    std::condition_variable changed;
+};
+
+#endif //OPERATINGSYSTEMSCLASS_TASKGRAPH_H
@@ -0,0 +1,287 @@
+#ifndef OPERATINGSYSTEMSCLASS_THREADPOOL_H
+#define OPERATINGSYSTEMSCLASS_THREADPOOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <execution>
+#include <mutex>
+#include <numeric>
+#include <optional>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "IdleWait.h"
+
+// Who runs the chunks of a parallelFor, picked at runtime with ThreadPool::setBackend
+enum class ParallelBackend {
+    Pool,   // the pool's own workers, the default
+    OpenMP, // an omp parallel for with dynamic scheduling, only when built with OpenMP
+    StdPar, // std::for_each(par) over one share per worker, each claiming chunks as it goes
+};
+
+inline const char* backendName(ParallelBackend backend) {
+    switch (backend) {
+        case ParallelBackend::Pool: return "pool";
+        case ParallelBackend::OpenMP: return "openmp";
+        case ParallelBackend::StdPar: return "stdpar";
+    }
+    return "?";
+}
+
+inline std::optional<ParallelBackend> parseBackend(std::string_view name) {
+    for (auto backend : {ParallelBackend::Pool, ParallelBackend::OpenMP, ParallelBackend::StdPar}) {
+        if (name == backendName(backend)) return backend;
+    }
+    return std::nullopt;
+}
+
+/*
+ * Fixed set of workers running one parallel loop at a time:
+ *  -> the caller publishes the loop and wakes the workers
+ *  -> everyone, caller included, grabs chunks of grain iterations from a shared counter
+ *  -> the caller waits until every worker has left the loop
+ *
+ * Both waits, workers for the next loop and the caller for the workers, go through
+ * idleWait: spin for the policy's window, then spin, yield or sleep. With waits
+ * tracked, their durations land in per worker histograms (start) and the caller's
+ * (join), next to how long each worker took to wake up (wake), see waitStats().
+ *
+ * The body receives (begin, end, worker), worker being in [0, size()), so it can
+ * use per thread scratch buffers without atomics. Bodies must not start another
+ * parallelFor on the same pool.
+ *
+ * The chunks can be handed to OpenMP or the standard parallel algorithms instead of
+ * the pool's workers, with the same guarantees: size() workers at most, each index
+ * used by one thread at a time. Only the pool's path and OpenMP's give the caller
+ * worker 0.
+ */
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned threads = std::max(1u, std::thread::hardware_concurrency()))
+            : startWaits(std::max(1u, threads)), wakeLatencies(std::max(1u, threads)) {
+        setIdlePolicy(IdlePolicy{});
+        for (unsigned w = 1; w < threads; w++) {
+            workers.emplace_back([this, w] { workerLoop(w); });
+        }
+    }
+
+    ~ThreadPool() {
+        stopping.store(true, std::memory_order_relaxed);
+        generation.fetch_add(1, std::memory_order_release);
+        generation.notify_all();
+        for (auto& worker : workers) worker.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    [[nodiscard]] unsigned size() const { return unsigned(workers.size()) + 1; }
+
+    static bool available(ParallelBackend backend) {
+#ifdef _OPENMP
+        constexpr bool openMP = true;
+#else
+        constexpr bool openMP = false;
+#endif
+        return backend != ParallelBackend::OpenMP || openMP;
+    }
+
+    // Returns false, keeping the current backend, when this build lacks the one asked for
+    bool setBackend(ParallelBackend next) {
+        if (!available(next)) return false;
+        backend = next;
+        return true;
+    }
+
+    [[nodiscard]] ParallelBackend getBackend() const { return backend; }
+
+    // Calibrates the spin window on this machine; takes effect from the next wait
+    void setIdlePolicy(const IdlePolicy& next) {
+        policy = next;
+        strategy.store(next.strategy, std::memory_order_relaxed);
+        spins.store(next.strategy == IdleStrategy::Spin ? 0 : calibrateSpins(next.spinWindow), std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] const IdlePolicy& idlePolicy() const { return policy; }
+
+    struct WaitStats {
+        WaitHistogram start; // workers waiting for a loop, all workers merged
+        WaitHistogram join;  // the caller waiting for the workers to finish one
+        WaitHistogram wake;  // from the caller publishing a loop to a worker running it
+    };
+
+    // Timing every wait costs two clock reads, so it is off until asked for
+    void trackWaits(bool enabled) { tracking.store(enabled, std::memory_order_relaxed); }
+
+    [[nodiscard]] WaitStats waitStats() const {
+        WaitStats stats;
+        for (const WaitRecorder& recorder : startWaits) recorder.addTo(stats.start);
+        joinWaits.addTo(stats.join);
+        for (const WaitRecorder& recorder : wakeLatencies) recorder.addTo(stats.wake);
+        return stats;
+    }
+
+    void resetWaitStats() {
+        for (WaitRecorder& recorder : startWaits) recorder.reset();
+        for (WaitRecorder& recorder : wakeLatencies) recorder.reset();
+        joinWaits.reset();
+    }
+
+    template<class Fn>
+    void parallelFor(size_t begin, size_t end, size_t grain, Fn&& fn) {
+        if (begin >= end) return;
+        grain = std::max<size_t>(grain, 1);
+        if (workers.empty() || end - begin <= grain) {
+            fn(begin, end, 0u);
+            return;
+        }
+        switch (backend) {
+            case ParallelBackend::Pool:
+                poolFor(begin, end, grain, fn);
+                return;
+            case ParallelBackend::OpenMP:
+                openMPFor(begin, end, grain, fn);
+                return;
+            case ParallelBackend::StdPar:
+                stdParFor(begin, end, grain, fn);
+                return;
+        }
+    }
+
+    // Runs fn(worker) once per worker, all at the same time and the caller as worker 0,
+    // on the pool's own threads whatever the backend; for bodies that wait on each other
+    template<class Fn>
+    void forEachWorker(Fn&& fn) {
+        if (workers.empty()) return fn(0u);
+        poolFor(0, size(), 1, [&](size_t, size_t, unsigned worker) { fn(worker); }, true);
+    }
+
+private:
+    // eachWorker: every thread runs the body once on its own index instead of claiming
+    // chunks, which a caller finding the workers asleep would otherwise all take itself
+    template<class Fn>
+    void poolFor(size_t begin, size_t end, size_t grain, Fn&& fn, bool eachWorker = false) {
+        std::lock_guard submit(submitMutex);
+        Loop loop{begin, end, grain, &fn, [](void* body, size_t b, size_t e, unsigned w) {
+            (*static_cast<std::remove_reference_t<Fn>*>(body))(b, e, w);
+        }, eachWorker};
+        current = &loop;
+        const bool timed = tracking.load(std::memory_order_relaxed);
+        published = timed ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point{};
+        busy.store(uint32_t(workers.size()), std::memory_order_relaxed);
+        generation.fetch_add(1, std::memory_order_release);
+        generation.notify_all();
+
+        runChunks(loop, 0);
+
+        const auto start = timed ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point{};
+        for (uint32_t left; (left = busy.load(std::memory_order_acquire)) != 0;) {
+            idleWait(busy, left, strategy.load(std::memory_order_relaxed), spins.load(std::memory_order_relaxed));
+        }
+        if (timed) joinWaits.add(elapsedNanoseconds(start));
+        current = nullptr;
+    }
+
+    static uint64_t elapsedNanoseconds(std::chrono::steady_clock::time_point since) {
+        return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - since).count());
+    }
+
+    template<class Fn>
+    void openMPFor(size_t begin, size_t end, size_t grain, Fn& fn) {
+#ifdef _OPENMP
+        std::lock_guard submit(submitMutex);
+        const auto chunks = int64_t((end - begin + grain - 1) / grain);
+        #pragma omp parallel for schedule(dynamic, 1) num_threads(size())
+        for (int64_t c = 0; c < chunks; c++) {
+            size_t b = begin + size_t(c) * grain;
+            fn(b, std::min(b + grain, end), unsigned(omp_get_thread_num()));
+        }
+#else
+        poolFor(begin, end, grain, fn);
+#endif
+    }
+
+    // The shares are the elements, one per worker index, so bodies keep their per worker
+    // buffers without thread ids; each share claims chunks from a shared counter, so a
+    // share with slow chunks does not hold the others back. par, not par_unseq: bodies
+    // allocate and take locks, which vectorisation unsafe code must not.
+    template<class Fn>
+    void stdParFor(size_t begin, size_t end, size_t grain, Fn& fn) {
+        std::lock_guard submit(submitMutex);
+        if (shares.size() != size()) {
+            shares.resize(size());
+            std::iota(shares.begin(), shares.end(), 0u);
+        }
+        std::atomic<size_t> next = begin;
+        std::for_each(std::execution::par, shares.begin(), shares.end(), [&](unsigned worker) {
+            for (size_t b; (b = next.fetch_add(grain, std::memory_order_relaxed)) < end;) {
+                fn(b, std::min(b + grain, end), worker);
+            }
+        });
+    }
+
+    struct Loop {
+        size_t begin, end, grain;
+        void* body;
+        void (*invoke)(void*, size_t, size_t, unsigned);
+        bool eachWorker;
+        std::atomic<size_t> next{0};
+
+        Loop(size_t begin, size_t end, size_t grain, void* body, void (*invoke)(void*, size_t, size_t, unsigned),
+             bool eachWorker)
+                : begin(begin), end(end), grain(grain), body(body), invoke(invoke), eachWorker(eachWorker), next(begin) {}
+    };
+
+    static void runChunks(Loop& loop, unsigned worker) {
+        if (loop.eachWorker) return loop.invoke(loop.body, worker, worker + 1, worker);
+        while (true) {
+            size_t b = loop.next.fetch_add(loop.grain, std::memory_order_relaxed);
+            if (b >= loop.end) return;
+            loop.invoke(loop.body, b, std::min(b + loop.grain, loop.end), worker);
+        }
+    }
+
+    void workerLoop(unsigned worker) {
+        uint32_t seen = 0;
+        while (true) {
+            const bool timed = tracking.load(std::memory_order_relaxed);
+            const auto start = timed ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point{};
+            idleWait(generation, seen, strategy.load(std::memory_order_relaxed), spins.load(std::memory_order_relaxed));
+            seen = generation.load(std::memory_order_acquire);
+            if (stopping.load(std::memory_order_relaxed)) return;
+            if (timed) startWaits[worker].add(elapsedNanoseconds(start));
+            if (published != std::chrono::steady_clock::time_point{}) {
+                wakeLatencies[worker].add(elapsedNanoseconds(published));
+            }
+
+            runChunks(*current, worker);
+            if (busy.fetch_sub(1, std::memory_order_acq_rel) == 1) busy.notify_one();
+        }
+    }
+
+    std::vector<std::thread> workers;
+    ParallelBackend backend = ParallelBackend::Pool;
+    std::vector<unsigned> shares;
+    std::mutex submitMutex;
+    // current and published are published by the release increment of generation
+    Loop* current = nullptr;
+    std::chrono::steady_clock::time_point published;
+    std::atomic<uint32_t> busy = 0;
+    std::atomic<uint32_t> generation = 0;
+    std::atomic<bool> stopping = false;
+
+    IdlePolicy policy;
+    std::atomic<IdleStrategy> strategy = IdleStrategy::Sleep;
+    std::atomic<uint32_t> spins = 0;
+    std::atomic<bool> tracking = false;
+    std::vector<WaitRecorder> startWaits, wakeLatencies;
+    WaitRecorder joinWaits;
+};
+
+#endif //OPERATINGSYSTEMSCLASS_THREADPOOL_H
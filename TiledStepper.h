@@ -0,0 +1,270 @@
+#ifndef OPERATINGSYSTEMSCLASS_TILEDSTEPPER_H
+#define OPERATINGSYSTEMSCLASS_TILEDSTEPPER_H
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "CollisionSolver.h"
+#include "ForceFields.h"
+#include "ParticleArrays.h"
+#include "ThreadPool.h"
+
+struct TilingConfig {
+    uint32_t substeps = 1;          // steps per block, 1 turns tiling off
+    uint32_t tileParticles = 16384; // about an L2 worth of particle, slot and contact data
+};
+
+/*
+ * Temporal blocking: instead of streaming every particle through the cache once per
+ * step, the world is cut into tiles and each tile runs several steps while it is
+ * still in cache.
+ *
+ *  -> bin the particles into tiles of about tileParticles each
+ *  -> per tile, copy the tile plus a halo into a local world and step it alone
+ *  -> keep only the tile's own particles, the halo ones are thrown away
+ *
+ * A particle's step only depends on particles within one radius of it once both
+ * moved. If no particle moves more than B per step, what the tile's particles see in
+ * step k started at most radius + 2kB further out than what they saw in step k - 1,
+ * so a halo of K * radius + K(K + 1) * B covers everything K steps depend on (the
+ * trapezoid) and whatever goes wrong at its outer edge never reaches the tile.
+ *
+ * B is a guess from the previous blocks. The moves of the local particles still
+ * inside the trapezoid are measured, both the integrated velocity and the final
+ * displacement, and a block where one exceeds B is rejected for the caller to step
+ * untiled. Every particle belongs to exactly one tile, so the check covers the
+ * whole world.
+ *
+ * Positions stay in world coordinates, so tiles see the same contacts with the same
+ * pushes as the untiled step; at most the order the pushes are summed in can differ,
+ * as it already does between thread counts.
+ */
+class TiledStepper {
+public:
+    // Advances state by steps steps; returns false, leaving state untouched, when the block has to run untiled
+    bool advance(ParticleArrays& state, const SolverConfig& config, const ForceStage& forces,
+                 uint32_t steps, uint32_t tileParticles, ThreadPool& pool) {
+        const size_t count = state.size();
+        if (count == 0 || steps == 0) return true;
+
+        float speed = 0.0f;
+        for (size_t i = 0; i < count; i++) {
+            speed = std::max(speed, std::hypot(state.vx[i] + state.fx[i], state.vy[i] + state.fy[i]));
+        }
+        // Forces are applied inside the block, so the first guess leaves room for them and for pushes
+        const float bound = stepBound > 0.0f ? std::max(stepBound, speed) : speed + 0.5f * config.radius;
+        const float k = float(steps);
+        const float halo = k * config.radius + k * (k + 1) * bound;
+        layoutTiles(state, config, halo, tileParticles);
+
+        // Tiles get a dense grid over just the tile and its halo; one cut by a periodic seam uses the
+        // hashed grid, which is sized by the particles instead of the world
+        SolverConfig local = config;
+        local.gridMode = GridMode::Hashed;
+        local.broadPhase = BroadPhase::Grid;
+        if (workers.size() < pool.size()) workers.resize(pool.size(), Worker(local));
+
+        out.resize(count);
+        std::atomic<float> moved = 0.0f;
+        pool.parallelFor(0, tileCount(), 1, [&](size_t begin, size_t end, unsigned w) {
+            float largest = 0.0f;
+            for (size_t t = begin; t < end; t++) {
+                largest = std::max(largest, runTile(workers[w], uint32_t(t), state, local, forces, steps, halo, bound));
+            }
+            float seen = moved.load(std::memory_order_relaxed);
+            while (largest > seen && !moved.compare_exchange_weak(seen, largest, std::memory_order_relaxed)) {}
+        });
+
+        if (moved.load() > bound) {
+            // Try again next block with room for what was seen
+            stepBound = 2 * moved.load();
+            return false;
+        }
+        stepBound = 1.5f * moved.load();
+        state.x.swap(out.x);
+        state.y.swap(out.y);
+        state.vx.swap(out.vx);
+        state.vy.swap(out.vy);
+        state.fx.swap(out.fx);
+        state.fy.swap(out.fy);
+        return true;
+    }
+
+    [[nodiscard]] uint32_t tileCount() const { return uint32_t(tilesX * tilesY); }
+
+private:
+    struct Worker {
+        explicit Worker(const SolverConfig& config) : solver(config) {}
+
+        CollisionSolver solver;
+        ParticleArrays local;
+        std::vector<uint32_t> global;
+        std::vector<uint32_t> owned; // local indices of the tile's own particles
+        std::vector<float> lastX, lastY;
+        std::vector<float> slack; // how far inside the halo's outer edge each local particle started
+        std::vector<int> columns, rows;
+    };
+
+    struct Axis {
+        float origin{}, extent{}, tile{};
+        int tiles = 1;
+        bool periodic{};
+
+        [[nodiscard]] int tileOf(float p) const { return std::clamp(int((p - origin) / tile), 0, tiles - 1); }
+        // A dense grid can cover the tile and its halo unless a periodic seam cuts through them
+        [[nodiscard]] bool windowed() const { return !periodic || tiles == 1; }
+        [[nodiscard]] std::pair<float, float> window(int t, float halo) const {
+            if (periodic) return {0.0f, extent};
+            float lo = origin + float(t) * tile;
+            return {lo - halo, lo + tile + halo};
+        }
+
+        // Distance from p to the tile's span, across the seam on a periodic axis
+        [[nodiscard]] float gap(float p, int t) const {
+            float lo = origin + float(t) * tile, hi = lo + tile;
+            if (periodic) {
+                float mid = 0.5f * (lo + hi), d = p - mid;
+                d -= extent * std::round(d / extent);
+                return std::max(0.0f, std::abs(d) - 0.5f * tile);
+            }
+            return std::max({0.0f, lo - p, p - hi});
+        }
+    };
+
+    void layoutTiles(const ParticleArrays& state, const SolverConfig& config, float halo, uint32_t tileParticles) {
+        const size_t count = state.size();
+        auto [minX, maxX] = std::minmax_element(state.x.begin(), state.x.end());
+        auto [minY, maxY] = std::minmax_element(state.y.begin(), state.y.end());
+        ax = {*minX, *maxX - *minX, 0.0f, 1, config.boundaryX == BoundaryMode::Periodic};
+        ay = {*minY, *maxY - *minY, 0.0f, 1, config.boundaryY == BoundaryMode::Periodic};
+        if (ax.periodic) ax.origin = 0.0f, ax.extent = config.width;
+        if (ay.periodic) ay.origin = 0.0f, ay.extent = config.height;
+        ax.extent = std::max(ax.extent, config.radius);
+        ay.extent = std::max(ay.extent, config.radius);
+
+        // Square tiles holding tileParticles at the average density, never thinner than the halo
+        float side = std::sqrt(ax.extent * ay.extent * float(tileParticles) / float(count));
+        side = std::max(side, halo);
+        for (Axis* a : {&ax, &ay}) {
+            a->tiles = std::max(1, int(a->extent / side));
+            a->tile = a->extent / float(a->tiles);
+        }
+        tilesX = ax.tiles;
+        tilesY = ay.tiles;
+
+        tileStart.assign(tileCount() + 1, 0);
+        particleTile.resize(count);
+        for (size_t i = 0; i < count; i++) {
+            particleTile[i] = uint32_t(ay.tileOf(state.y[i]) * tilesX + ax.tileOf(state.x[i]));
+            tileStart[particleTile[i] + 1]++;
+        }
+        for (size_t t = 1; t < tileStart.size(); t++) tileStart[t] += tileStart[t - 1];
+        tiled.resize(count);
+        fill.assign(tileStart.begin(), tileStart.end() - 1);
+        for (size_t i = 0; i < count; i++) tiled[fill[particleTile[i]]++] = uint32_t(i);
+    }
+
+    // Columns (or rows) of tiles within reach of tile t, each listed once even when the halo wraps around
+    static void neighbourTiles(const Axis& a, int t, float reach, std::vector<int>& out) {
+        out.clear();
+        int span = int(std::ceil(reach / a.tile));
+        if (2 * span + 1 >= a.tiles) {
+            for (int n = 0; n < a.tiles; n++) out.push_back(n);
+            return;
+        }
+        for (int d = -span; d <= span; d++) {
+            int n = t + d;
+            if (a.periodic) n = (n + a.tiles) % a.tiles;
+            else if (n < 0 || n >= a.tiles) continue;
+            out.push_back(n);
+        }
+    }
+
+    // Steps one tile and its halo locally, writes the tile's particles to out, returns the largest local move
+    float runTile(Worker& worker, uint32_t tile, const ParticleArrays& state, const SolverConfig& config,
+                  const ForceStage& forces, uint32_t steps, float halo, float bound) {
+        const int tx = int(tile % tilesX), ty = int(tile / tilesX);
+        if (tileStart[tile] == tileStart[tile + 1]) return 0.0f;
+
+        ParticleArrays& local = worker.local;
+        local.resize(0);
+        worker.global.clear();
+        worker.owned.clear();
+        worker.slack.clear();
+        neighbourTiles(ax, tx, halo, worker.columns);
+        neighbourTiles(ay, ty, halo, worker.rows);
+        for (int ny : worker.rows) {
+            for (int nx : worker.columns) {
+                uint32_t n = uint32_t(ny * tilesX + nx);
+                for (uint32_t s = tileStart[n]; s < tileStart[n + 1]; s++) {
+                    uint32_t i = tiled[s];
+                    float gap = std::max(ax.gap(state.x[i], tx), ay.gap(state.y[i], ty));
+                    if (n != tile && gap > halo) continue;
+                    if (n == tile) worker.owned.push_back(uint32_t(local.size()));
+                    worker.slack.push_back(n == tile ? halo : halo - gap);
+                    worker.global.push_back(i);
+                    local.push(state.x[i], state.y[i], state.vx[i], state.vy[i]);
+                    local.fx.back() = state.fx[i];
+                    local.fy.back() = state.fy[i];
+                }
+            }
+        }
+
+        worker.solver.setConfig(config);
+        if (ax.windowed() && ay.windowed()) {
+            auto [x0, x1] = ax.window(tx, halo);
+            auto [y0, y1] = ay.window(ty, halo);
+            worker.solver.setGridWindow(x0, y0, x1, y1);
+        }
+
+        const AxisImage ix = config.boundaryX == BoundaryMode::Periodic ? AxisImage{config.width, 1 / config.width} : AxisImage{};
+        const AxisImage iy = config.boundaryY == BoundaryMode::Periodic ? AxisImage{config.height, 1 / config.height} : AxisImage{};
+        float largest = 0.0f;
+        worker.lastX.resize(local.size());
+        worker.lastY.resize(local.size());
+        for (uint32_t k = 0; k < steps; k++) {
+            // Only particles still inside the trapezoid are exact, the rest may move anyhow
+            const float cone = float(k) * config.radius + bound * float(k) * float(k + 1);
+            forces.apply(local);
+            for (size_t l = 0; l < local.size(); l++) {
+                worker.lastX[l] = local.x[l];
+                worker.lastY[l] = local.y[l];
+                if (worker.slack[l] < cone) continue;
+                float vx = local.vx[l] + local.fx[l], vy = local.vy[l] + local.fy[l];
+                largest = std::max(largest, std::sqrt(vx * vx + vy * vy));
+            }
+            worker.solver.step(local);
+            for (size_t l = 0; l < local.size(); l++) {
+                if (worker.slack[l] < cone) continue;
+                float dx = local.x[l] - worker.lastX[l];
+                float dy = local.y[l] - worker.lastY[l];
+                dx -= ix.period * std::round(dx * ix.invPeriod);
+                dy -= iy.period * std::round(dy * iy.invPeriod);
+                largest = std::max(largest, std::sqrt(dx * dx + dy * dy));
+            }
+        }
+
+        for (uint32_t l : worker.owned) {
+            uint32_t i = worker.global[l];
+            out.x[i] = local.x[l];
+            out.y[i] = local.y[l];
+            out.vx[i] = local.vx[l];
+            out.vy[i] = local.vy[l];
+            out.fx[i] = local.fx[l];
+            out.fy[i] = local.fy[l];
+        }
+        return largest;
+    }
+
+    Axis ax, ay;
+    int tilesX = 1, tilesY = 1;
+    float stepBound = 0.0f;
+    std::vector<uint32_t> tileStart, particleTile, tiled, fill;
+    std::vector<Worker> workers;
+    ParticleArrays out;
+};
+
+#endif //OPERATINGSYSTEMSCLASS_TILEDSTEPPER_H
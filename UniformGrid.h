@@ -0,0 +1,433 @@
+#ifndef OPERATINGSYSTEMSCLASS_UNIFORMGRID_H
+#define OPERATINGSYSTEMSCLASS_UNIFORMGRID_H
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <bit>
+#include <utility>
+#include <span>
+#include <iostream>
+#include "ParallelPrimitives.h"
+#include "Scalar.h"
+
+// Inclusive range of cell coordinates that can hold particles
+struct CellBounds {
+    int64_t minX, minY, maxX, maxY;
+};
+
+/*
+ * Dense grid over [0, width] x [0, height] rebuilt every step with a counting sort.
+ *
+ * The interior cells are surrounded by one ring of ghost cells, so every interior
+ * cell has all 8 neighbours without any bounds checks. On a periodic axis the
+ * particles of the first and last interior column (or row) are also copied into
+ * the ghost ring on the opposite side; on a wall axis the ghost ring stays empty.
+ * Ghost slots keep the particle's real position, the collision kernel applies the
+ * minimum image convention to get the distance across the seam.
+ *
+ * Cells are stored row major, so the three cells (x-1, x, x+1) of a neighbour row
+ * are one contiguous range of slots. Every row ends in one more cell that never
+ * holds a particle: with incremental binning its slots are the row's slack.
+ *
+ * Binning also fills a two level occupancy bitmap of the interior cells: one bit
+ * per cell, and one summary bit per 64 cell word. Traversals skip 4096 empty cells
+ * per zero summary word and 64 per zero cell word, so they cost what the occupied
+ * cells cost even when the particles only cover a corner of the domain.
+ *
+ * A build is two halves, so callers can spread the second over workers:
+ *  -> bin: which particle goes in which cell, and the occupancy bitmap
+ *  -> binRows: lays out the slots of any range of storage rows (ghost rows 0 and
+ *     cellsY + 1 included) and copies the positions in, touching no other row
+ *
+ * With incremental binning on, a bin after the first one only re-bins the
+ * particles whose home cell changed:
+ *  -> recompute every home cell, collecting the movers
+ *  -> more than REBIN_CHURN_LIMIT of the particles moved, or a row would outgrow
+ *     its slack: full counting sort, which hands out fresh slack
+ *  -> otherwise the movers' old and new slots (ghost images included) are radix
+ *     sorted by cell, and occupancy bits change only for the cells they left or
+ *     entered. binRows then edits each row they touch in place: in the cells
+ *     between its first and last edit, old slots of the movers are dropped and new
+ *     ones appended, the cells after the last edit shift into or out of the slack
+ *     as one block. Rows without movers keep their layout.
+ * Every particle moved, so every slot still takes its new position, but as one
+ * sequential pass per row rather than a scatter.
+ *
+ * S is the solver's scalar, which the slots copy the positions in; cell indices are
+ * computed in CellScalar<S>.
+ */
+template<class S>
+class BasicUniformGrid {
+public:
+    using Coord = CellScalar<S>;
+
+    // The grid covers [x0, x0 + width] x [y0, y0 + height]; only worlds without a periodic axis may move it off 0
+    void configure(Coord width, Coord height, Coord minCellSize, bool periodicX, bool periodicY,
+                   Coord x0 = 0, Coord y0 = 0) {
+        // On a periodic axis the cells have to tile the domain exactly, otherwise a
+        // narrower last cell would let contacts reach two cells across the seam.
+        // At least 3 cells are needed so x-1 and x+1 are never the same cell, and
+        // shrinking them below minCellSize would miss contacts, so refuse instead.
+        if ((periodicX && width < 3 * minCellSize) || (periodicY && height < 3 * minCellSize)) {
+            std::cout << "ERROR::UNIFORMGRID::PERIOD_TOO_SMALL\n" << double(width) << " x " << double(height)
+                      << " needs at least " << 3 * double(minCellSize) << " on a periodic axis" << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        cellsX = std::max(1, int(width / minCellSize));
+        cellsY = std::max(1, int(height / minCellSize));
+        invCellX = Coord(cellsX) / width;
+        invCellY = Coord(cellsY) / height;
+        originX = x0;
+        originY = y0;
+        wrapX = periodicX;
+        wrapY = periodicY;
+        binned = false;
+
+        stride = cellsX + 3;
+        cellStart.assign(size_t(stride) * (cellsY + 2) + 1, 0);
+        occupancy.assign((homeCellCount() + 63) / 64, 0);
+        summary.assign((occupancy.size() + 63) / 64, 0);
+    }
+
+    void build(const S* x, const S* y, size_t count) {
+        bin(x, y, count);
+        binRows(x, y, 0, storageRows(), rowSlots);
+    }
+
+    // First half of a build; the slots are not usable until binRows has run once on every row
+    void bin(const S* x, const S* y, size_t count) {
+        for (uint32_t i : moved) movedFlag[i] = 0;
+        if (incremental && binned && count == particleCell.size() && planRebin(x, y, count)) return;
+        fullBuild(x, y, count);
+    }
+
+    // Second half, for storage rows [begin, end) after bin, once each. Calls on disjoint
+    // ranges may run concurrently, each with its own scratch.
+    void binRows(const S* x, const S* y, uint32_t begin, uint32_t end, std::vector<uint32_t>& scratch) {
+        auto e = size_t(std::lower_bound(editCell.begin(), editCell.end(), begin * stride) - editCell.begin());
+        const auto last = std::lower_bound(editCell.begin() + e, editCell.end(), end * stride) - editCell.begin();
+        while (e < size_t(last)) {
+            const size_t rowEnd = rowEdits(e);
+            editRow(e, rowEnd, scratch);
+            e = rowEnd;
+        }
+        for (uint32_t row = begin; row < end; row++) {
+            const uint32_t slotsEnd = cellStart[row * stride + stride - 1];
+            for (uint32_t s = cellStart[row * stride]; s < slotsEnd; s++) {
+                slotX[s] = x[slotParticle[s]];
+                slotY[s] = y[slotParticle[s]];
+            }
+        }
+    }
+
+    // Rows of cells in storage: the home rows and the two ghost rows
+    [[nodiscard]] uint32_t storageRows() const { return uint32_t(cellsY + 2); }
+
+    void setIncremental(bool enabled) { incremental = enabled; }
+
+    // Particles that changed cell in the last build, and whether it fell back to a full sort
+    [[nodiscard]] size_t lastMoves() const { return moved.size(); }
+    [[nodiscard]] bool lastBuildWasFull() const { return fullLast; }
+
+    [[nodiscard]] uint32_t cellOf(S x, S y) const {
+        int cx = std::clamp(int((Coord(x) - originX) * invCellX), 0, cellsX - 1) + 1;
+        int cy = std::clamp(int((Coord(y) - originY) * invCellY), 0, cellsY - 1) + 1;
+        return uint32_t(cy * stride + cx);
+    }
+
+    // First and one past last slot of the cells (x-1, x, x+1) in the row dy away from cell
+    [[nodiscard]] std::pair<uint32_t, uint32_t> rowSpan(uint32_t cell, int dy) const {
+        uint32_t row = cell + dy * stride;
+        return {cellStart[row - 1], cellStart[row + 2]};
+    }
+
+    // Cells holding real particles, in slot order
+    [[nodiscard]] uint32_t homeCellCount() const { return uint32_t(cellsX * cellsY); }
+    [[nodiscard]] uint32_t homeCell(uint32_t k) const {
+        return uint32_t((k / cellsX + 1) * stride + k % cellsX + 1);
+    }
+
+    // Calls fn(cell) for the occupied home cells with index in [begin, end), in order
+    template<class Fn>
+    void forEachOccupiedCell(uint32_t begin, uint32_t end, Fn&& fn) const {
+        if (begin >= end) return;
+        const uint32_t firstWord = begin / 64, lastWord = (end - 1) / 64;
+        uint32_t w = firstWord;
+        while (w <= lastWord) {
+            uint64_t words = summary[w / 64] >> (w % 64);
+            if (words == 0) {
+                w = (w / 64 + 1) * 64;
+                continue;
+            }
+            w += std::countr_zero(words);
+            if (w > lastWord) return;
+
+            uint64_t bits = occupancy[w];
+            if (w == firstWord) bits &= ~uint64_t(0) << (begin % 64);
+            if (w == lastWord && end % 64) bits &= ~uint64_t(0) >> (64 - end % 64);
+            while (bits) {
+                fn(homeCell(w * 64 + std::countr_zero(bits)));
+                bits &= bits - 1;
+            }
+            w++;
+        }
+    }
+
+    // Half shell: the cell to the right and the three cells of the row above. Together
+    // with the pairs inside cell, every pair of neighbouring slots is seen exactly once,
+    // ghost cells standing in for the cells across a periodic seam.
+    template<class Fn>
+    void forEachForwardSpan(uint32_t cell, Fn&& fn) const {
+        fn(cellStart[cell + 1], cellStart[cell + 2]);
+        auto [begin, end] = rowSpan(cell, 1);
+        fn(begin, end);
+    }
+
+    // Interior cell coordinates for queries, not clamped so callers can tell "outside"
+    [[nodiscard]] int64_t cellX(Coord x) const { return int64_t(std::floor((x - originX) * invCellX)); }
+    [[nodiscard]] int64_t cellY(Coord y) const { return int64_t(std::floor((y - originY) * invCellY)); }
+
+    [[nodiscard]] CellBounds cellBounds() const { return {0, 0, cellsX - 1, cellsY - 1}; }
+
+    // Calls fn(begin, end) with the slots of the interior cells in [x0, x1] x [y0, y1], one span per row
+    template<class Fn>
+    void forEachCellSpanIn(int64_t x0, int64_t y0, int64_t x1, int64_t y1, Fn&& fn) const {
+        x0 = std::max<int64_t>(x0, 0);
+        y0 = std::max<int64_t>(y0, 0);
+        x1 = std::min<int64_t>(x1, cellsX - 1);
+        y1 = std::min<int64_t>(y1, cellsY - 1);
+        if (x0 > x1) return;
+        for (int64_t cy = y0; cy <= y1; cy++) {
+            int64_t row = (cy + 1) * stride + 1;
+            uint32_t begin = cellStart[row + x0], end = cellStart[row + x1 + 1];
+            if (begin != end) fn(begin, end);
+        }
+    }
+
+    int cellsX{}, cellsY{}, stride{};
+    Coord invCellX{}, invCellY{};
+    Coord originX{}, originY{};
+
+    std::vector<uint32_t> cellStart;
+    std::vector<uint32_t> particleCell;
+    std::vector<uint32_t> slotParticle;
+    std::vector<S> slotX, slotY;
+
+private:
+    static constexpr float REBIN_CHURN_LIMIT = 0.2f;
+    // Slack slots per row after a full build: a fraction of its own slots, plus room for an arriving row
+    static constexpr float ROW_SLACK = 0.125f;
+    static constexpr uint32_t ROW_SLACK_MIN = 16;
+    static constexpr uint32_t REMOVED = UINT32_MAX;
+
+    void markOccupied(uint32_t cell) {
+        uint32_t k = homeIndex(cell);
+        occupancy[k / 64] |= uint64_t(1) << (k % 64);
+        summary[k / 4096] |= uint64_t(1) << (k / 64 % 64);
+    }
+
+    void clearOccupied(uint32_t cell) {
+        uint32_t k = homeIndex(cell);
+        occupancy[k / 64] &= ~(uint64_t(1) << (k % 64));
+        if (occupancy[k / 64] == 0) summary[k / 4096] &= ~(uint64_t(1) << (k / 64 % 64));
+    }
+
+    // Counting sort of every particle, positions left to binRows
+    void fullBuild(const S* x, const S* y, size_t count) {
+        binned = true;
+        fullLast = true;
+        moved.clear();
+        editCell.clear();
+        editParticle.clear();
+        particleCell.resize(count);
+        std::fill(cellStart.begin(), cellStart.end(), 0);
+        std::fill(occupancy.begin(), occupancy.end(), 0);
+        std::fill(summary.begin(), summary.end(), 0);
+
+        // count, cellStart[c + 1] holds the number of slots in cell c
+        uint32_t slots = 0;
+        for (size_t i = 0; i < count; i++) {
+            particleCell[i] = cellOf(x[i], y[i]);
+            markOccupied(particleCell[i]);
+            forEachImage(particleCell[i], [&](uint32_t cell) {
+                cellStart[cell + 1]++;
+                slots++;
+            });
+        }
+
+        // The slack cell closing each row gets room for the row to grow into. A settling
+        // lattice moves whole rows of particles into empty rows at once, so every row can
+        // take in the largest one, up to twice the average.
+        if (incremental) {
+            const auto rows = uint32_t(cellsY + 2);
+            uint32_t largest = 0;
+            for (uint32_t row = 0; row < rows; row++) largest = std::max(largest, rowLive(row));
+            const uint32_t arriving = std::min(largest, 2 * slots / rows);
+            for (uint32_t row = 0; row < rows; row++) {
+                const uint32_t slack = row * stride + stride - 1;
+                cellStart[slack + 1] = uint32_t(ROW_SLACK * float(rowLive(row))) + arriving + ROW_SLACK_MIN;
+                slots += cellStart[slack + 1];
+            }
+        }
+
+        for (size_t c = 1; c < cellStart.size(); c++) {
+            cellStart[c] += cellStart[c - 1];
+        }
+
+        slotParticle.resize(slots);
+        slotX.resize(slots);
+        slotY.resize(slots);
+        fill.assign(cellStart.begin(), cellStart.end() - 1);
+
+        for (size_t i = 0; i < count; i++) {
+            forEachImage(particleCell[i], [&](uint32_t cell) {
+                slotParticle[fill[cell]++] = uint32_t(i);
+            });
+        }
+    }
+
+
+    // Returns false, leaving the grid untouched, when too many particles moved or a row ran out of slack
+    bool planRebin(const S* x, const S* y, size_t count) {
+        moved.clear();
+        movedTo.clear();
+        const auto churnLimit = size_t(REBIN_CHURN_LIMIT * float(count));
+        for (size_t i = 0; i < count; i++) {
+            const uint32_t cell = cellOf(x[i], y[i]);
+            if (cell == particleCell[i]) continue;
+            moved.push_back(uint32_t(i));
+            movedTo.push_back(cell);
+            if (moved.size() > churnLimit) return false;
+        }
+
+        // Cell and particle of the new slots of the movers, cell and REMOVED for the old ones
+        editCell.clear();
+        editParticle.clear();
+        auto edit = [&](uint32_t cell, uint32_t particle) {
+            editCell.push_back(cell);
+            editParticle.push_back(particle);
+        };
+        for (size_t m = 0; m < moved.size(); m++) {
+            forEachImage(particleCell[moved[m]], [&](uint32_t cell) { edit(cell, REMOVED); });
+            forEachImage(movedTo[m], [&](uint32_t cell) { edit(cell, moved[m]); });
+        }
+        editSorter.sort(nullptr, std::span(editCell), std::span(editParticle));
+        for (size_t e = 0; e < editCell.size();) {
+            const size_t rowEnd = rowEdits(e);
+            const uint32_t slack = slackCell(editCell[e]);
+            if (rowGrowth(e, rowEnd) > int64_t(cellStart[slack + 1] - cellStart[slack])) {
+                editCell.clear();
+                editParticle.clear();
+                return false;
+            }
+            e = rowEnd;
+        }
+        fullLast = false;
+
+        movedFlag.resize(count);
+        for (uint32_t i : moved) movedFlag[i] = 1;
+        // A home cell's slot count after the edits tells whether it is still occupied
+        for (size_t e = 0; e < editCell.size();) {
+            const uint32_t cell = editCell[e];
+            int64_t slots = cellStart[cell + 1] - cellStart[cell];
+            for (; e < editCell.size() && editCell[e] == cell; e++) slots += editParticle[e] == REMOVED ? -1 : 1;
+            const int cx = int(cell % stride), cy = int(cell / stride);
+            if (cx < 1 || cx > cellsX || cy < 1 || cy > cellsY) continue;
+            if (slots > 0) markOccupied(cell);
+            else clearOccupied(cell);
+        }
+        for (size_t m = 0; m < moved.size(); m++) particleCell[moved[m]] = movedTo[m];
+        return true;
+    }
+
+    // Applies the sorted edits [e, rowEnd) of one row to its slots and cellStart
+    void editRow(size_t e, size_t rowEnd, std::vector<uint32_t>& scratch) {
+        uint32_t* slots = slotParticle.data();
+        const int64_t growth = rowGrowth(e, rowEnd);
+        const uint32_t first = editCell[e], last = editCell[rowEnd - 1], slack = slackCell(first);
+
+        // The edited cells and those between them are rebuilt from a copy
+        const uint32_t base = cellStart[first], tailBegin = cellStart[last + 1], tailEnd = cellStart[slack];
+        scratch.assign(slots + base, slots + tailBegin);
+
+        // The cells after the last edited one only shift, as one block, into or out of the slack
+        if (growth > 0) std::copy_backward(slots + tailBegin, slots + tailEnd, slots + tailEnd + growth);
+        if (growth < 0) std::copy(slots + tailBegin, slots + tailEnd, slots + tailBegin + growth);
+        for (uint32_t c = last + 1; c <= slack; c++) cellStart[c] = uint32_t(cellStart[c] + growth);
+
+        uint32_t w = base, r = 0;
+        for (uint32_t c = first; e < rowEnd; ) {
+            const uint32_t cell = editCell[e];
+            const uint32_t blockEnd = cellStart[cell] - base;
+            const int64_t shift = int64_t(w) - int64_t(base + r);
+            for (; c < cell; c++) cellStart[c] = uint32_t(cellStart[c] + shift);
+            w = uint32_t(std::copy(scratch.begin() + r, scratch.begin() + blockEnd, slots + w) - slots);
+            r = blockEnd;
+
+            const uint32_t oldEnd = (cell == last ? tailBegin : cellStart[cell + 1]) - base;
+            cellStart[cell] = w;
+            for (; r < oldEnd; r++) {
+                if (!movedFlag[scratch[r]]) slots[w++] = scratch[r];
+            }
+            for (; e < rowEnd && editCell[e] == cell; e++) {
+                if (editParticle[e] != REMOVED) slots[w++] = editParticle[e];
+            }
+            c = cell + 1;
+        }
+    }
+
+    [[nodiscard]] uint32_t slackCell(uint32_t cell) const { return cell / stride * stride + stride - 1; }
+
+    // Slots of a row while fullBuild's cellStart still holds counts
+    [[nodiscard]] uint32_t rowLive(uint32_t row) const {
+        uint32_t live = 0;
+        for (uint32_t c = row * stride; c < row * stride + stride - 1; c++) live += cellStart[c + 1];
+        return live;
+    }
+
+    // One past the last of the sorted edits in the same row as edit e
+    [[nodiscard]] size_t rowEdits(size_t e) const {
+        const uint32_t slack = slackCell(editCell[e]);
+        while (e < editCell.size() && editCell[e] < slack) e++;
+        return e;
+    }
+
+    [[nodiscard]] int64_t rowGrowth(size_t begin, size_t end) const {
+        int64_t growth = 0;
+        for (size_t e = begin; e < end; e++) growth += editParticle[e] == REMOVED ? -1 : 1;
+        return growth;
+    }
+
+    [[nodiscard]] uint32_t homeIndex(uint32_t cell) const {
+        return (cell / stride - 1) * cellsX + cell % stride - 1;
+    }
+
+    // Calls fn for the home cell and, on periodic axes, the ghost cells mirroring it
+    template<class Fn>
+    void forEachImage(uint32_t cell, Fn&& fn) const {
+        fn(cell);
+        int cx = int(cell % stride), cy = int(cell / stride);
+        int gx = !wrapX ? cx : cx == 1 ? cellsX + 1 : cx == cellsX ? 0 : cx;
+        int gy = !wrapY ? cy : cy == 1 ? cellsY + 1 : cy == cellsY ? 0 : cy;
+        if (gx != cx) fn(uint32_t(cy * stride + gx));
+        if (gy != cy) fn(uint32_t(gy * stride + cx));
+        if (gx != cx && gy != cy) fn(uint32_t(gy * stride + gx));
+    }
+
+    bool wrapX{}, wrapY{};
+    std::vector<uint32_t> fill;
+    std::vector<uint64_t> occupancy, summary;
+
+    bool incremental = false, binned = false, fullLast = true;
+    std::vector<uint32_t> moved, movedTo;
+    std::vector<uint8_t> movedFlag;
+    std::vector<uint32_t> editCell, editParticle;
+    RadixSorter<uint32_t, uint32_t> editSorter;
+    std::vector<uint32_t> rowSlots;
+};
+
+using UniformGrid = BasicUniformGrid<float>;
+
+#endif //OPERATINGSYSTEMSCLASS_UNIFORMGRID_H
@@ -0,0 +1,300 @@
+#ifndef OPERATINGSYSTEMSCLASS_VALIDATION_H
+#define OPERATINGSYSTEMSCLASS_VALIDATION_H
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <optional>
+#include <vector>
+#include "CollisionSolver.h"
+#include "ParallelPrimitives.h"
+#include "ParticleSim.h"
+#include "Scalar.h"
+
+/*
+ * Proof that an optimisation did not change the results:
+ *  -> stateHash: a bit exact hash of the positions and velocities, cheap enough to
+ *     take every step
+ *  -> ReferenceSolver: the solver's step written plainly, every pair in index order,
+ *     no grid, no SIMD, no threads
+ *  -> DifferentialValidator: steps the optimised solver and the reference from the
+ *     same state, compares the hashes and, when they differ, finds the particle that
+ *     moved furthest from the reference, reporting the first step it exceeded the
+ *     tolerance
+ *
+ * Every checked step restarts the reference from the optimised state, so rounding
+ * differences of float runs do not compound into chaos, and tools or spawns between
+ * steps need no mirroring. A Fixed32 run has to match the reference bit for bit.
+ */
+
+// Bits of a scalar, widened to 64
+template<class S>
+uint64_t scalarBits(S value) {
+    if constexpr (sizeof(S) == sizeof(uint64_t)) return std::bit_cast<uint64_t>(value);
+    else return std::bit_cast<uint32_t>(value);
+}
+
+// MurmurHash3's finaliser: every input bit flips about half the output bits
+inline uint64_t mix64(uint64_t k) {
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdull;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ull;
+    k ^= k >> 33;
+    return k;
+}
+
+// Each particle's words are mixed with its index on their own and the results summed, so
+// blocks hash in parallel, the value does not depend on the pool, and swapping two
+// particles changes it as much as changing a bit
+template<class S>
+uint64_t stateHash(ThreadPool* pool, const BasicParticleArrays<S>& state) {
+    return parallelReduce(pool, state.size(), uint64_t(0), [&](size_t i) {
+        uint64_t h = mix64(uint64_t(i) * 0x9E3779B97F4A7C15ull ^ scalarBits(state.x[i]));
+        h = mix64(h ^ scalarBits(state.y[i]));
+        h = mix64(h ^ scalarBits(state.vx[i]));
+        return mix64(h ^ scalarBits(state.vy[i]));
+    }, [](uint64_t a, uint64_t b) { return a + b; });
+}
+
+// Minimum image of one offset, as the solver's kernels compute it
+template<class S> requires std::is_floating_point_v<S>
+S referenceImage(S d, S period) {
+    if (period == S(0)) return d;
+    return d - period * std::round(d * (S(1) / period));
+}
+
+inline Fixed32 referenceImage(Fixed32 d, Fixed32 period) {
+    if (d.raw > period.raw / 2) return d - period;
+    if (d.raw < -(period.raw / 2)) return d + period;
+    return d;
+}
+
+// Half the overlap along the offset, for the particle the offset points from; false when not touching
+template<class S> requires std::is_floating_point_v<S>
+bool referencePush(S dx, S dy, S radius, S& moveX, S& moveY) {
+    const S d2 = dx * dx + dy * dy;
+    if (!(d2 < radius * radius) || !(d2 > S(0))) return false;
+    const S d = std::sqrt(d2);
+    const S push = (radius - d) * S(0.5) / d;
+    moveX = dx * push;
+    moveY = dy * push;
+    return true;
+}
+
+inline bool referencePush(Fixed32 dx, Fixed32 dy, Fixed32 radius, Fixed32& moveX, Fixed32& moveY) {
+    const int64_t d2 = int64_t(dx.raw) * dx.raw + int64_t(dy.raw) * dy.raw;
+    if (d2 >= int64_t(radius.raw) * radius.raw || d2 <= 0) return false;
+    const int64_t d = integerSqrt(d2);
+    moveX = Fixed32::fromRaw(int32_t(dx.raw * (radius.raw - d) / (2 * d)));
+    moveY = Fixed32::fromRaw(int32_t(dy.raw * (radius.raw - d) / (2 * d)));
+    return true;
+}
+
+/*
+ * The step BasicCollisionSolver::step takes, in its simplest form: integrate, apply
+ * the boundaries, sum the push of every touching pair, apply the sums, stop the
+ * particles that touched, apply the boundaries again. Quadratic in the particles, for
+ * checking scenes of thousands, not millions.
+ */
+template<class S>
+class ReferenceSolver {
+public:
+    explicit ReferenceSolver(const SolverConfig& config)
+            : config(config), width(S(config.width)), height(S(config.height)), radius(S(config.radius)) {}
+
+    void step(BasicParticleArrays<S>& state) {
+        const size_t count = state.size();
+        for (size_t i = 0; i < count; i++) {
+            state.vx[i] += state.fx[i];
+            state.vy[i] += state.fy[i];
+            state.fx[i] = S(0);
+            state.fy[i] = S(0);
+            state.x[i] += state.vx[i];
+            state.y[i] += state.vy[i];
+        }
+        applyBoundaries(state);
+
+        correctionX.assign(count, S(0));
+        correctionY.assign(count, S(0));
+        touching.assign(count, 0);
+        const S periodX = config.boundaryX == BoundaryMode::Periodic ? width : S(0);
+        const S periodY = config.boundaryY == BoundaryMode::Periodic ? height : S(0);
+        for (size_t i = 0; i < count; i++) {
+            for (size_t j = i + 1; j < count; j++) {
+                S moveX, moveY;
+                S dx = referenceImage(state.x[i] - state.x[j], periodX);
+                S dy = referenceImage(state.y[i] - state.y[j], periodY);
+                if (!referencePush(dx, dy, radius, moveX, moveY)) continue;
+                correctionX[i] += moveX;
+                correctionY[i] += moveY;
+                correctionX[j] -= moveX;
+                correctionY[j] -= moveY;
+                touching[i] = touching[j] = 1;
+            }
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            state.x[i] += correctionX[i];
+            state.y[i] += correctionY[i];
+            if (touching[i]) {
+                state.vx[i] = S(0);
+                state.vy[i] = S(0);
+            }
+        }
+        applyBoundaries(state);
+    }
+
+private:
+    static void applyAxis(BoundaryMode mode, S extent, S& p, S& v) {
+        if (mode == BoundaryMode::Periodic) {
+            p = wrapPeriodic(p, extent);
+        } else if (mode == BoundaryMode::Wall && p < S(0)) {
+            p = S(0);
+            v = -v;
+        } else if (mode == BoundaryMode::Wall && p > extent) {
+            p = extent;
+            v = -v;
+        }
+    }
+
+    void applyBoundaries(BasicParticleArrays<S>& state) const {
+        for (size_t i = 0; i < state.size(); i++) {
+            applyAxis(config.boundaryX, width, state.x[i], state.vx[i]);
+            applyAxis(config.boundaryY, height, state.y[i], state.vy[i]);
+        }
+    }
+
+    SolverConfig config;
+    S width, height, radius;
+    std::vector<S> correctionX, correctionY;
+    std::vector<uint8_t> touching;
+};
+
+/*
+ * A tolerance for checking S runs against the reference. Fixed32 adds up exactly, so
+ * it gets 0. Floating point solvers add a particle's pushes in broad phase order rather
+ * than index order, which rounds differently by an ulp or so of the coordinates per
+ * push: 16 ulps of the largest coordinate the world allows.
+ */
+template<class S>
+double referenceTolerance(const SolverConfig& config) {
+    if constexpr (std::is_floating_point_v<S>) {
+        return 16 * double(std::numeric_limits<S>::epsilon()) * std::max(config.width, config.height);
+    } else {
+        return 0.0;
+    }
+}
+
+// Where a checked step first went further from the reference than the tolerance
+struct Divergence {
+    uint64_t step{};     // counting the validator's steps from 1, the last of a block of several
+    uint32_t particle{}; // the one furthest from the reference
+    double position{}, velocity{};
+};
+
+template<class S>
+class DifferentialValidator {
+public:
+    // Tolerance 0 asks for the reference's values exactly, only -0 and +0 may differ
+    DifferentialValidator(const SolverConfig& config, double tolerance)
+            : config(config), tolerance(tolerance), reference(config) {}
+
+    // For worlds whose config changed between steps
+    void setConfig(const SolverConfig& newConfig) {
+        config = newConfig;
+        reference = ReferenceSolver<S>(newConfig);
+    }
+
+    /*
+     * Steps state steps times through optimized(), and a copy of where it started
+     * through forces(copy) and the reference, steps times. forces has to apply what the
+     * optimised step applies before its solver, e.g. the world's force stage. Returns
+     * false when the two ended further apart than the tolerance.
+     */
+    template<class Optimized, class Forces>
+    bool step(BasicParticleArrays<S>& state, ThreadPool* pool, uint32_t steps, Optimized&& optimized, Forces&& forces) {
+        expected = state;
+        optimized();
+        for (uint32_t s = 0; s < steps; s++) {
+            forces(expected);
+            reference.step(expected);
+        }
+        checkedSteps += steps;
+
+        lastHash = stateHash(pool, state);
+        if (lastHash == stateHash(pool, expected)) {
+            identicalSteps += steps;
+            return true;
+        }
+        const Difference worst = largestDifference(pool, state);
+        worstError = std::max(worstError, worst.error);
+        if (worst.error <= tolerance) return true;
+        divergedChecks++;
+        if (!first) first = Divergence{checkedSteps, worst.particle, worst.position, worst.velocity};
+        return false;
+    }
+
+    [[nodiscard]] const std::optional<Divergence>& firstDivergence() const { return first; }
+    // Hash of the optimised state after the last checked step
+    [[nodiscard]] uint64_t stateHashAfterLastStep() const { return lastHash; }
+    [[nodiscard]] uint64_t steps() const { return checkedSteps; }
+    [[nodiscard]] uint64_t bitIdenticalSteps() const { return identicalSteps; }
+    [[nodiscard]] double largestError() const { return worstError; }
+
+    void print(std::ostream& out) const {
+        out << "  " << checkedSteps << " steps checked, " << identicalSteps << " bit-identical to the reference, "
+            << divergedChecks << " checks over the tolerance of " << tolerance << ", largest error " << worstError << "\n";
+        if (first) {
+            out << "  first divergence at step " << first->step << ", particle " << first->particle << ": position off by "
+                << first->position << ", velocity by " << first->velocity << "\n";
+        }
+        out.flush();
+    }
+
+private:
+    struct Difference {
+        double error = -1;
+        uint32_t particle{};
+        double position{}, velocity{};
+    };
+
+    // The particle furthest from the reference in position or velocity, the lowest index on ties
+    Difference largestDifference(ThreadPool* pool, const BasicParticleArrays<S>& state) const {
+        const double periodX = config.boundaryX == BoundaryMode::Periodic ? config.width : 0.0;
+        const double periodY = config.boundaryY == BoundaryMode::Periodic ? config.height : 0.0;
+        auto image = [](double d, double period) { return period > 0 ? d - period * std::round(d / period) : d; };
+        return parallelReduce(pool, state.size(), Difference{}, [&](size_t i) {
+            const double dx = image(double(state.x[i]) - double(expected.x[i]), periodX);
+            const double dy = image(double(state.y[i]) - double(expected.y[i]), periodY);
+            const double dvx = double(state.vx[i]) - double(expected.vx[i]);
+            const double dvy = double(state.vy[i]) - double(expected.vy[i]);
+            const double position = std::sqrt(dx * dx + dy * dy), velocity = std::sqrt(dvx * dvx + dvy * dvy);
+            // NaN compares false against everything, it would never be the largest
+            const double error = std::isnan(position) || std::isnan(velocity) ? INFINITY : std::max(position, velocity);
+            return Difference{error, uint32_t(i), position, velocity};
+        }, [](const Difference& a, const Difference& b) {
+            return b.error > a.error || (b.error == a.error && b.particle < a.particle) ? b : a;
+        });
+    }
+
+    SolverConfig config;
+    double tolerance;
+    ReferenceSolver<S> reference;
+    BasicParticleArrays<S> expected;
+    std::optional<Divergence> first;
+    uint64_t checkedSteps{}, identicalSteps{}, divergedChecks{}, lastHash{};
+    double worstError{};
+};
+
+// One world.step(steps) checked against the reference, which applies the world's force stage
+inline bool validatedStep(ParticleWorld& world, DifferentialValidator<float>& validator, uint32_t steps = 1,
+                          const RegionFn& onRegion = {}) {
+    return validator.step(world.arrays(), &world.threads(), steps, [&] { world.step(steps, onRegion); },
+                          [&](ParticleArrays& state) { world.forces().apply(state, world.threads()); });
+}
+
+#endif //OPERATINGSYSTEMSCLASS_VALIDATION_H
@@ -0,0 +1,637 @@
+/*
+ * Headless benchmarks for the simulation code, no window needed.
+ *
+ *   ParticleBenchmarks [section...] [--threads N] [--particles N] [--queries N] [--backend NAME]
+ *                      [--budget MS] [--cores LIST] [--world-gib G]
+ *
+ * Without sections every section runs. Scenes are generated the same way
+ * ParticleCollisionDemo::createPoints lays out its particles, scaled up.
+ *
+ * The chunked section writes a world of --world-gib to the temporary directory, a
+ * quarter of a GiB by default, and removes it afterwards. Pass more than the
+ * machine's RAM to see it page, on a disk-backed temporary directory since tmpfs
+ * would keep the files in RAM anyway.
+ *
+ * The realtime section locks memory and switches threads to SCHED_FIFO for the rest
+ * of the process, so it runs last.
+ */
+
+#define FMT_HEADER_ONLY
+#include <fmt/core.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <numeric>
+#include <optional>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ChunkedWorld.h"
+#include "FrameRecorder.h"
+#include "ParallelPrimitives.h"
+#include "ParticleSim.h"
+#include "RealTime.h"
+#include "SpatialQuery.h"
+#include "ThreadPool.h"
+#include "Validation.h"
+
+struct BenchOptions {
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    size_t particles = 1'000'000;
+    size_t queries = 1'000'000;
+    float radius = 8.0f;
+    ParallelBackend backend = ParallelBackend::Pool;
+    RealTimeConfig realTime;
+    double worldGiB = 0.25; // chunked section
+};
+
+struct Scene {
+    SolverConfig config;
+    ParticleArrays state;
+};
+
+// createPoints' rows between 3/8 and 5/8 of the width, in a world wide enough for count particles
+static Scene rowScene(size_t count, float radius) {
+    const float spacing = radius * 1.2f;
+    const float rowLength = std::max(250.0f, std::sqrt(float(count)) * spacing);
+    const float width = rowLength * 4, height = float(count) / (rowLength / spacing) * spacing + 200;
+
+    Scene scene{{width, height, radius}, {}};
+    float x = 3 * width / 8, y = 100;
+    for (size_t i = 0; i < count; i++) {
+        scene.state.push(x, y, 0.0f, -1.0f);
+        x += spacing;
+        if (x > 5 * width / 8) {
+            y += spacing;
+            x = 3 * width / 8;
+        }
+    }
+    return scene;
+}
+
+template<class Fn>
+static double bestSeconds(int repeats, Fn&& fn) {
+    double best = 1e30;
+    for (int r = 0; r < repeats; r++) {
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+    return best;
+}
+
+static void report(const char* name, size_t operations, double seconds) {
+    fmt::print("  {:<28} {:>12.0f} /s   {:>9.3f} ms\n", name, double(operations) / seconds, seconds * 1e3);
+}
+
+/*
+ * A row scene as a ParticleWorld, stepped until the rows reach the floor and pile up,
+ * so the contacts are part of every measurement. tweak adjusts the config first;
+ * threads and backend default to the options'.
+ */
+static std::unique_ptr<ParticleWorld> settledWorld(const BenchOptions& options,
+                                                   const std::function<void(SolverConfig&)>& tweak = nullptr,
+                                                   unsigned threads = 0,
+                                                   std::optional<ParallelBackend> backend = std::nullopt) {
+    Scene scene = rowScene(options.particles, options.radius);
+    if (tweak) tweak(scene.config);
+    auto world = std::make_unique<ParticleWorld>(scene.config, threads ? threads : options.threads);
+    world->threads().setBackend(backend.value_or(options.backend));
+    world->addParticles(scene.state);
+    world->step(120);
+    return world;
+}
+
+static void benchQueries(const BenchOptions& options, ThreadPool& pool) {
+    for (GridMode mode : {GridMode::Dense, GridMode::Hashed}) {
+        Scene scene = rowScene(options.particles, options.radius);
+        scene.config.gridMode = mode;
+        SpatialQueries queries;
+        queries.publish(scene.state, scene.config, 0);
+        auto snapshot = queries.snapshot();
+
+        fmt::print("queries: {} particles, {} grid, {} threads\n", scene.state.size(),
+                   mode == GridMode::Dense ? "dense" : "hashed", pool.size());
+        report("index build", scene.state.size(), bestSeconds(1, [&] { snapshot->ensureIndex(); }));
+
+        std::mt19937 rng(7);
+        std::uniform_int_distribution<size_t> pick(0, scene.state.size() - 1);
+        std::uniform_real_distribution<float> angle(0.0f, 6.2831853f);
+        std::vector<RadiusQuery> radius(options.queries);
+        std::vector<PointQuery> points(options.queries);
+        std::vector<BoxQuery> boxes(options.queries);
+        std::vector<RayQuery> rays(options.queries);
+        for (size_t q = 0; q < options.queries; q++) {
+            size_t p = pick(rng);
+            float x = scene.state.x[p], y = scene.state.y[p], a = angle(rng);
+            radius[q] = {x, y, 2 * options.radius};
+            points[q] = {x, y};
+            boxes[q] = {x - 2 * options.radius, y - options.radius, x + 2 * options.radius, y + options.radius};
+            rays[q] = {x, y, std::cos(a), std::sin(a), 50 * options.radius};
+        }
+
+        QueryResults results;
+        std::vector<uint32_t> nearest;
+        std::vector<RayHit> hits;
+        report("radius", radius.size(), bestSeconds(3, [&] { snapshot->radiusBatch(radius, results, pool); }));
+        report("k-nearest (k = 8)", points.size(), bestSeconds(3, [&] { snapshot->nearestBatch(points, 8, nearest, pool); }));
+        report("aabb", boxes.size(), bestSeconds(3, [&] { snapshot->boxBatch(boxes, results, pool); }));
+        report("ray cast", rays.size(), bestSeconds(3, [&] {
+            snapshot->raycastBatch(rays, options.radius / 2, hits, pool);
+        }));
+    }
+}
+
+// One fused pass per configuration, so adding fields should cost arithmetic, not bandwidth
+static void benchForces(const BenchOptions& options, ThreadPool& pool) {
+    Scene scene = rowScene(options.particles, options.radius);
+    const float cx = scene.config.width / 2, cy = scene.config.height / 2;
+
+    FlowTexture flow{.width = 256, .height = 256, .cellSize = scene.config.width / 255, .strength = 0.01f,
+                     .u = std::vector<float>(256 * 256), .v = std::vector<float>(256 * 256)};
+    for (uint32_t s = 0; s < 256 * 256; s++) {
+        flow.u[s] = std::sin(float(s % 256) * 0.1f);
+        flow.v[s] = std::cos(float(s / 256) * 0.1f);
+    }
+
+    fmt::print("forces: {} particles, {} threads\n", scene.state.size(), pool.size());
+    ForceStage stage;
+    stage.add({FieldKind::Gravity, 0.0f, -0.01f});
+    report("gravity", scene.state.size(), bestSeconds(5, [&] { stage.apply(scene.state, pool); }));
+    stage.add({FieldKind::Wind, 1.0f, 0.0f, 0.05f});
+    stage.add({FieldKind::Vortex, cx, cy, 0.1f, cy});
+    stage.add({FieldKind::Vortex, cx / 2, cy, -0.1f, cy / 2});
+    report("gravity+wind+2 vortices", scene.state.size(), bestSeconds(5, [&] { stage.apply(scene.state, pool); }));
+    stage.add(flow);
+    report("fields + flow texture", scene.state.size(), bestSeconds(5, [&] { stage.apply(scene.state, pool); }));
+}
+
+// Whole steps through the library API, the path the viewer and the ensemble runner take
+static void benchStep(const BenchOptions& options) {
+    for (GridMode mode : {GridMode::Dense, GridMode::Hashed}) {
+        auto world = settledWorld(options, [&](SolverConfig& config) { config.gridMode = mode; });
+        fmt::print("step: {} particles, {} grid, {} threads\n", world->size(),
+                   mode == GridMode::Dense ? "dense" : "hashed", world->threads().size());
+        report("particle steps", world->size(), bestSeconds(5, [&] { world->step(); }));
+        fmt::print("  {:<28} {:>12}\n", "contacts per step", world->contactCount());
+    }
+}
+
+// Full counting sort every step against re-binning only the particles that changed cell
+static void benchBinning(const BenchOptions& options) {
+    for (bool incremental : {false, true}) {
+        auto world = settledWorld(options, [&](SolverConfig& config) { config.incrementalBinning = incremental; });
+        fmt::print("binning: {} particles, {} rebuild, {} threads\n", world->size(),
+                   incremental ? "incremental" : "full", world->threads().size());
+        report("particle steps", world->size(), bestSeconds(5, [&] { world->step(); }));
+    }
+}
+
+// The broad phases on the same row scenes, through whole steps
+static void benchBroadPhase(const BenchOptions& options) {
+    struct Variant {
+        const char* name;
+        GridMode grid;
+        BroadPhase broad;
+    };
+    const Variant variants[] = {{"dense grid", GridMode::Dense, BroadPhase::Grid},
+                                {"hashed grid", GridMode::Hashed, BroadPhase::Grid},
+                                {"sweep and prune", GridMode::Dense, BroadPhase::SweepAndPrune}};
+    fmt::print("broadphase: {} particles, {} threads\n", options.particles, options.threads);
+    for (const Variant& variant : variants) {
+        auto world = settledWorld(options, [&](SolverConfig& config) {
+            config.gridMode = variant.grid;
+            config.broadPhase = variant.broad;
+        });
+        report(variant.name, world->size(), bestSeconds(5, [&] { world->step(); }));
+    }
+}
+
+template<class S>
+static BasicParticleArrays<S> convertState(const ParticleArrays& state) {
+    BasicParticleArrays<S> out;
+    for (size_t i = 0; i < state.size(); i++) out.push(S(state.x[i]), S(state.y[i]), S(state.vx[i]), S(state.vy[i]));
+    return out;
+}
+
+template<class S>
+static bool sameBits(const BasicParticleArrays<S>& a, const BasicParticleArrays<S>& b) {
+    auto same = [](const std::vector<S>& u, const std::vector<S>& v) {
+        return u.size() == v.size() && std::memcmp(u.data(), v.data(), u.size() * sizeof(S)) == 0;
+    };
+    return same(a.x, b.x) && same(a.y, b.y) && same(a.vx, b.vx) && same(a.vy, b.vy);
+}
+
+// The viewer's window of rows, given sideways velocities so that under gravity it piles up
+// with several contacts per particle
+static Scene viewerScene(float radius) {
+    constexpr float WIDTH = 1000, HEIGHT = 800;
+    constexpr uint32_t COUNT = 1500;
+    const float spacing = radius * 1.2f;
+    Scene scene{{WIDTH, HEIGHT, radius}, {}};
+    float x = 3 * WIDTH / 8, y = 100;
+    for (uint32_t i = 0; i < COUNT; i++) {
+        scene.state.push(x, y, float(i * 7919 % 13) * 0.1f - 0.6f, -1.0f);
+        x += spacing;
+        if (x > 5 * WIDTH / 8) {
+            y += spacing;
+            x = 3 * WIDTH / 8;
+        }
+    }
+    return scene;
+}
+
+template<class S>
+static void applyGravity(BasicParticleArrays<S>& state) {
+    std::fill(state.fy.begin(), state.fy.end(), S(-0.05f));
+}
+
+// The solver on each scalar: whole steps on the row scene, then whether the viewer's scene
+// ends up with the same bits stepped serially on the dense grid and on the pool with sweep
+// and prune, which sum the pushes in other orders
+template<class S>
+static void benchScalar(const BenchOptions& options, ThreadPool& pool) {
+    Scene scene = rowScene(options.particles, options.radius);
+    auto state = convertState<S>(scene.state);
+    BasicCollisionSolver<S> solver(scene.config);
+    for (int s = 0; s < 120; s++) solver.step(state, pool);
+    report(scalarName<S>(), state.size(), bestSeconds(5, [&] { solver.step(state, pool); }));
+
+    constexpr uint32_t STEPS = 300;
+    Scene viewer = viewerScene(options.radius);
+    SolverConfig sweepConfig = viewer.config;
+    sweepConfig.broadPhase = BroadPhase::SweepAndPrune;
+    BasicCollisionSolver<S> dense(viewer.config), sweep(sweepConfig);
+    auto serial = convertState<S>(viewer.state), parallel = serial;
+    for (uint32_t s = 0; s < STEPS; s++) {
+        applyGravity(serial);
+        applyGravity(parallel);
+        dense.step(serial);
+        sweep.step(parallel, pool);
+    }
+    fmt::print("    serial dense grid vs {} thread sweep and prune after {} steps: {}\n", pool.size(), STEPS,
+               sameBits(serial, parallel) ? "bit-identical" : "different");
+}
+
+static void benchPrecision(const BenchOptions& options, ThreadPool& pool) {
+    fmt::print("precision: {} particles, {} threads\n", options.particles, pool.size());
+    benchScalar<float>(options, pool);
+    benchScalar<double>(options, pool);
+    benchScalar<Fixed32>(options, pool);
+}
+
+template<class S>
+static void reportValidation(const char* name, const DifferentialValidator<S>& validator) {
+    if (const auto& first = validator.firstDivergence()) {
+        fmt::print("  {:<28} differs from step {}, particle {}: position off by {:.3g}, velocity by {:.3g}\n", name,
+                   first->step, first->particle, first->position, first->velocity);
+    } else if (validator.bitIdenticalSteps() < validator.steps()) {
+        fmt::print("  {:<28} within {:.3g} for {} steps, {} bit-identical\n", name, validator.largestError(),
+                   validator.steps(), validator.bitIdenticalSteps());
+    } else {
+        fmt::print("  {:<28} bit-identical for {} steps\n", name, validator.steps());
+    }
+}
+
+// Every scalar's solver on the pool, then the world's tiled steps, checked step by step
+// against the reference on the viewer's scene at referenceTolerance, so 0 for Fixed32;
+// and the hash on its own
+template<class S>
+static void validateScalar(ThreadPool& pool, uint32_t steps, float radius) {
+    Scene viewer = viewerScene(radius);
+    auto state = convertState<S>(viewer.state);
+    BasicCollisionSolver<S> solver(viewer.config);
+    DifferentialValidator<S> validator(viewer.config, referenceTolerance<S>(viewer.config));
+    for (uint32_t s = 0; s < steps; s++) {
+        validator.step(state, &pool, 1, [&] {
+            applyGravity(state);
+            solver.step(state, pool);
+        }, [](BasicParticleArrays<S>& expected) { applyGravity(expected); });
+    }
+    reportValidation(scalarName<S>(), validator);
+}
+
+static void benchValidation(const BenchOptions& options, ThreadPool& pool) {
+    constexpr uint32_t STEPS = 300;
+    fmt::print("validate: {} steps of the viewer's scene, {} threads\n", STEPS, pool.size());
+    validateScalar<float>(pool, STEPS, options.radius);
+    validateScalar<double>(pool, STEPS, options.radius);
+    validateScalar<Fixed32>(pool, STEPS, options.radius);
+
+    Scene viewer = viewerScene(options.radius);
+    ParticleWorld world(viewer.config, options.threads);
+    world.threads().setBackend(options.backend);
+    world.addParticles(viewer.state);
+    world.forces().add({FieldKind::Gravity, 0.0f, -0.05f});
+    world.setTiling({4});
+    DifferentialValidator<float> validator(viewer.config, referenceTolerance<float>(viewer.config));
+    for (uint32_t s = 0; s < STEPS; s += 4) validatedStep(world, validator, 4);
+    reportValidation("world, 4 substeps tiled", validator);
+
+    Scene scene = rowScene(options.particles, options.radius);
+    uint64_t hash = 0;
+    report("state hash", scene.state.size(), bestSeconds(5, [&] { hash = stateHash(&pool, scene.state); }));
+    const uint64_t serial = stateHash<float>(nullptr, scene.state);
+    if (hash != serial) fmt::print("  MISMATCH: the pool's hash {:016x} against the serial {:016x}\n", hash, serial);
+}
+
+// The process's resident memory in bytes, from /proc/self/status
+static size_t residentBytes() {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.starts_with("VmRSS:")) return std::stoull(line.substr(6)) * 1024;
+    }
+    return 0;
+}
+
+// A resting world bigger than RAM, loaded chunk by chunk, with an awake patch in the
+// middle chunk running into its neighbours: only the patch's surroundings should stay mapped
+static void benchChunked(const BenchOptions& options) {
+    constexpr uint32_t SIDE = 128; // particles along a chunk's side, 2^14 per chunk fills its file exactly
+    constexpr uint32_t STEPS = 200;
+    const double gib = double(1u << 30);
+    const double ram = double(sysconf(_SC_PHYS_PAGES)) * double(sysconf(_SC_PAGESIZE));
+    const double chunkBytes = double(SIDE * SIDE * ChunkedWorld::PARTICLE_BYTES);
+    const auto chunksPerSide = uint32_t(std::ceil(std::sqrt(options.worldGiB * gib / chunkBytes)));
+    const float spacing = options.radius * 1.2f, chunkSize = SIDE * spacing;
+
+    const auto directory = std::filesystem::temp_directory_path() / "particle-bench-chunks";
+    const double needed = double(chunksPerSide) * chunksPerSide * chunkBytes;
+    std::error_code error;
+    const auto space = std::filesystem::space(directory.parent_path(), error);
+    if (error || double(space.available) < needed) {
+        fmt::print("chunked: skipped, {:.2f} GiB needed in {} but {:.2f} GiB available\n", needed / gib,
+                   directory.parent_path().string(), error ? 0.0 : double(space.available) / gib);
+        return;
+    }
+    SolverConfig config{chunksPerSide * chunkSize, chunksPerSide * chunkSize, options.radius};
+    config.gridMode = GridMode::Hashed;
+    size_t loadedBytes = 0, worst = 0;
+    {
+        ChunkedWorld world(directory.string(), chunkSize, config);
+        const uint32_t middle = chunksPerSide / 2;
+        const double loadSeconds = bestSeconds(1, [&] {
+            for (uint32_t cy = 0; cy < chunksPerSide; cy++) {
+                for (uint32_t cx = 0; cx < chunksPerSide; cx++) {
+                    for (uint32_t j = 0; j < SIDE; j++) {
+                        for (uint32_t i = 0; i < SIDE; i++) {
+                            const bool awake = cx == middle && cy == middle && i / 32 == 1 && j / 32 == 1;
+                            world.addParticle((float(cx * SIDE + i) + 0.5f) * spacing, (float(cy * SIDE + j) + 0.5f) * spacing,
+                                              awake ? 1.0f : 0.0f, awake ? 0.6f : 0.0f, awake);
+                        }
+                    }
+                }
+            }
+        });
+        loadedBytes = residentBytes();
+
+        fmt::print("chunked: {} particles in {} chunks, {:.2f} GiB of files, {:.2f} GiB of RAM\n", world.particleCount(),
+                   world.chunkCount(), double(world.fileBytes()) / gib, ram / gib);
+        report("load", world.particleCount(), loadSeconds);
+        size_t stepped = 0;
+        const double stepSeconds = bestSeconds(1, [&] {
+            for (uint32_t s = 0; s < STEPS; s++) {
+                world.step();
+                stepped += world.workingSet().size();
+                worst = std::max(worst, residentBytes());
+            }
+        });
+        report("working set particle steps", stepped, stepSeconds);
+        fmt::print("  {:<28} {:>12}   of {}\n", "chunks mapped", world.residentChunks(), world.chunkCount());
+    }
+    std::filesystem::remove_all(directory);
+    fmt::print("  {:<28} {:>12.1f} MB after loading, {:.1f} MB at most while stepping\n", "resident memory",
+               double(loadedBytes) * 1e-6, double(worst) * 1e-6);
+}
+
+// Blocks of substeps run tile by tile while the tile is in cache, against stepping the whole world each time
+static void benchTiled(const BenchOptions& options) {
+    fmt::print("tiled: {} particles, {} threads\n", options.particles, options.threads);
+    for (uint32_t substeps : {1u, 2u, 4u, 8u}) {
+        auto world = settledWorld(options);
+        world->setTiling({substeps});
+        auto name = substeps == 1 ? std::string("untiled") : fmt::format("{} substeps per block", substeps);
+        report(name.c_str(), world->size() * 8, bestSeconds(5, [&] { world->step(8); }));
+    }
+}
+
+// Every backend on the same scene, at 1, 2, 4, ... threads up to --threads
+static void benchBackends(const BenchOptions& options) {
+    fmt::print("backends: {} particles\n", options.particles);
+    for (auto backend : {ParallelBackend::Pool, ParallelBackend::OpenMP, ParallelBackend::StdPar}) {
+        if (!ThreadPool::available(backend)) {
+            fmt::print("  {:<28} not built in\n", backendName(backend));
+            continue;
+        }
+        double single = 0;
+        for (unsigned threads = 1;; threads = std::min(threads * 2, options.threads)) {
+            auto world = settledWorld(options, nullptr, threads, backend);
+            double seconds = bestSeconds(5, [&] { world->step(); });
+            if (threads == 1) single = seconds;
+            auto name = fmt::format("{} x{}", backendName(backend), threads);
+            fmt::print("  {:<28} {:>12.0f} /s   {:>9.3f} ms   {:>5.2f}x\n", name, double(world->size()) / seconds,
+                       seconds * 1e3, single / seconds);
+            if (threads >= options.threads) break;
+        }
+    }
+}
+
+// Every idle strategy on the same scene, with the pool's start and join waits timed
+static void benchIdle(const BenchOptions& options) {
+    fmt::print("idle: {} particles, {} threads\n", options.particles, options.threads);
+    for (auto strategy : {IdleStrategy::Spin, IdleStrategy::Yield, IdleStrategy::Sleep}) {
+        auto world = settledWorld(options);
+        world->threads().setIdlePolicy({strategy});
+        world->threads().trackWaits(true);
+        report(idleStrategyName(strategy), world->size(), bestSeconds(5, [&] { world->step(); }));
+
+        auto stats = world->threads().waitStats();
+        fmt::print("    start waits {:>8}   p50 {:>9} ns   p99 {:>9} ns\n", stats.start.total(),
+                   stats.start.percentile(0.5), stats.start.percentile(0.99));
+        fmt::print("    join waits  {:>8}   p50 {:>9} ns   p99 {:>9} ns\n", stats.join.total(),
+                   stats.join.percentile(0.5), stats.join.percentile(0.99));
+    }
+}
+
+// Each primitive at 10^3, 10^5 and 10^7 elements, checked against the standard library's serial version
+static void benchPrimitives(ThreadPool& pool) {
+    fmt::print("primitives: {} threads\n", pool.size());
+    std::mt19937_64 rng(7);
+    for (size_t n : {size_t(1'000), size_t(100'000), size_t(10'000'000)}) {
+        std::vector<float> values(n);
+        std::vector<uint32_t> counts(n), keys32(n), scanned(n), indices(n);
+        std::vector<uint64_t> keys64(n);
+        for (size_t i = 0; i < n; i++) {
+            values[i] = std::uniform_real_distribution<float>(-1.0f, 1.0f)(rng);
+            counts[i] = uint32_t(rng() % 8);
+            keys32[i] = uint32_t(rng());
+            keys64[i] = rng();
+        }
+        const int repeats = n < 1'000'000 ? 50 : 5;
+        bool ok = true;
+        auto name = [&](const char* what) { return fmt::format("{} {}", what, n); };
+
+        double reduced{};
+        report(name("sum").c_str(), n, bestSeconds(repeats, [&] { reduced = parallelSum(&pool, std::span<const float>(values)); }));
+        ok &= std::abs(reduced - std::reduce(values.begin(), values.end(), 0.0)) < 1e-3 * double(n);
+        MinMax<float> range;
+        report(name("min/max").c_str(), n, bestSeconds(repeats, [&] { range = parallelMinMax(&pool, std::span<const float>(values)); }));
+        ok &= range.min == *std::min_element(values.begin(), values.end());
+        ok &= range.max == *std::max_element(values.begin(), values.end());
+
+        report(name("exclusive scan").c_str(), n, bestSeconds(repeats, [&] {
+            exclusiveScan(&pool, std::span<const uint32_t>(counts), std::span(scanned));
+        }));
+        std::vector<uint32_t> expected(n);
+        std::exclusive_scan(counts.begin(), counts.end(), expected.begin(), 0u);
+        ok &= scanned == expected;
+
+        size_t kept = 0;
+        report(name("compact").c_str(), n, bestSeconds(repeats, [&] {
+            kept = compact(&pool, n, [&](size_t i) { return values[i] > 0.0f; },
+                           [&](size_t i, size_t k) { indices[k] = uint32_t(i); });
+        }));
+        expected.clear();
+        for (size_t i = 0; i < n; i++) {
+            if (values[i] > 0.0f) expected.push_back(uint32_t(i));
+        }
+        ok &= std::equal(expected.begin(), expected.end(), indices.begin(), indices.begin() + kept);
+
+        // Keys are sorted in place, so every repeat starts from a fresh copy, timed along
+        auto radix = [&](auto& sorter, const auto& source) {
+            auto sorted = source;
+            std::vector<uint32_t> payload(n);
+            double seconds = bestSeconds(repeats, [&] {
+                sorted = source;
+                std::iota(payload.begin(), payload.end(), 0u);
+                sorter.sort(&pool, std::span(sorted), std::span(payload));
+            });
+            for (size_t i = 0; i < n; i++) ok &= sorted[i] == source[payload[i]];
+            ok &= std::is_sorted(sorted.begin(), sorted.end());
+            return seconds;
+        };
+        RadixSorter<uint32_t, uint32_t> sorter32;
+        RadixSorter<uint64_t, uint32_t> sorter64;
+        report(name("radix sort 32").c_str(), n, radix(sorter32, keys32));
+        report(name("radix sort 64").c_str(), n, radix(sorter64, keys64));
+        std::vector<uint32_t> copy;
+        report(name("std::sort 32").c_str(), n, bestSeconds(repeats, [&] {
+            copy = keys32;
+            std::sort(copy.begin(), copy.end());
+        }));
+        if (!ok) fmt::print("  MISMATCH against the serial versions at {}\n", n);
+    }
+}
+
+// Full frames recorded through each writer backend, as the viewer's --record does. Each
+// backend gets a new file, removed afterwards: ext4 flushes a file truncated and rewritten
+static void benchWriter(const BenchOptions& options) {
+    constexpr uint64_t FRAMES = 64;
+    Scene scene = rowScene(options.particles, options.radius);
+    const double frameBytes = double(sizeof(FrameRecordHeader) + 4 * scene.state.size() * sizeof(float));
+    fmt::print("writer: {} particles, {:.1f} MB per frame\n", scene.state.size(), frameBytes * 1e-6);
+    for (auto backend : {WriterBackend::IoUring, WriterBackend::Threads}) {
+        ResumeQueue resumes;
+        AsyncWriter writer(resumes, backend);
+        if (writer.backend() != backend) {
+            fmt::print("  {:<28} not available\n", writerBackendName(backend));
+            continue;
+        }
+        const auto path = std::filesystem::temp_directory_path() /
+                          fmt::format("particle-bench-{}.rec", writerBackendName(backend));
+        double seconds;
+        {
+            FrameRecorder recorder(path.string(), FrameRecorder::Mode::Append, true, writer, resumes);
+            auto record = [&]() -> PipelineTask {
+                for (uint64_t frame = 0; frame < FRAMES; frame++) co_await recorder.record(scene.state, frame);
+                co_await recorder.flush();
+            };
+            seconds = bestSeconds(1, [&] {
+                PipelineTask task = record();
+                while (!task.done()) resumes.waitAndPump();
+            });
+        }
+        std::filesystem::remove(path);
+        auto name = fmt::format("{}{}", writerBackendName(backend), writer.registeredBuffers() ? ", registered" : "");
+        fmt::print("  {:<28} {:>12.0f} frames/s {:>9.1f} MB/s\n", name, double(FRAMES) / seconds,
+                   double(FRAMES) * frameBytes / seconds * 1e-6);
+    }
+}
+
+// Steps on a fixed period in real-time mode, one period per budget, and checks the p99.9 step against it
+static void benchRealTime(const BenchOptions& options) {
+    constexpr uint32_t STEPS = 1000;
+    fmt::print("realtime: {} particles, {} threads, {:.3f} ms budget\n", options.particles, options.threads,
+               double(options.realTime.budget.count()) * 1e-6);
+    auto world = settledWorld(options);
+    if (!enterRealTime(*world, options.realTime)) fmt::print("  not permitted, measuring without real-time mode\n");
+    world->threads().trackWaits(true);
+
+    JitterStats stats(options.realTime.budget);
+    runPeriodic(*world, options.realTime.budget, STEPS, stats);
+    std::cout.flush();
+    stats.print(std::cout, world->threads().waitStats().wake);
+}
+
+int main(int argc, char** argv) {
+    BenchOptions options;
+    std::vector<std::string> sections;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) options.threads = std::stoul(argv[++i]);
+        else if (std::strcmp(argv[i], "--particles") == 0 && i + 1 < argc) options.particles = std::stoul(argv[++i]);
+        else if (std::strcmp(argv[i], "--queries") == 0 && i + 1 < argc) options.queries = std::stoul(argv[++i]);
+        else if (std::strcmp(argv[i], "--backend") == 0 && i + 1 < argc) {
+            auto backend = parseBackend(argv[++i]);
+            if (!backend || !ThreadPool::available(*backend)) {
+                fmt::print("unknown or unavailable backend {}\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+            options.backend = *backend;
+        } else if (std::strcmp(argv[i], "--budget") == 0 && i + 1 < argc) {
+            options.realTime.budget = std::chrono::nanoseconds(int64_t(std::stod(argv[++i]) * 1e6));
+        } else if (std::strcmp(argv[i], "--cores") == 0 && i + 1 < argc) {
+            auto cores = parseCores(argv[++i]);
+            if (!cores) {
+                fmt::print("bad core list {}\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+            options.realTime.cores = *cores;
+        } else if (std::strcmp(argv[i], "--world-gib") == 0 && i + 1 < argc) {
+            options.worldGiB = std::stod(argv[++i]);
+            if (options.worldGiB <= 0) {
+                fmt::print("bad world size {}\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+        } else sections.emplace_back(argv[i]);
+    }
+
+    ThreadPool pool(options.threads);
+    pool.setBackend(options.backend);
+    const std::pair<const char*, std::function<void()>> all[] = {
+            {"step", [&] { benchStep(options); }},
+            {"binning", [&] { benchBinning(options); }},
+            {"broadphase", [&] { benchBroadPhase(options); }},
+            {"precision", [&] { benchPrecision(options, pool); }},
+            {"tiled", [&] { benchTiled(options); }},
+            {"backends", [&] { benchBackends(options); }},
+            {"idle", [&] { benchIdle(options); }},
+            {"queries", [&] { benchQueries(options, pool); }},
+            {"forces", [&] { benchForces(options, pool); }},
+            {"primitives", [&] { benchPrimitives(pool); }},
+            {"validate", [&] { benchValidation(options, pool); }},
+            {"writer", [&] { benchWriter(options); }},
+            {"chunked", [&] { benchChunked(options); }},
+            {"realtime", [&] { benchRealTime(options); }},
+    };
+    for (auto& [name, run] : all) {
+        if (sections.empty() || std::find(sections.begin(), sections.end(), name) != sections.end()) run();
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,73 @@
+/*
+ * Headless parameter sweep, every combination run as one scene of an Ensemble.
+ *
+ *   ParticleEnsemble [--out results.csv] [--steps N] [--threads N] [--samples N]
+ *                    [--radius MIN MAX] [--spacing MIN MAX] [--speed MIN MAX]
+ *
+ * Each range is sampled at --samples evenly spaced values, so the sweep runs
+ * samples^3 scenes of ParticleCollisionDemo's size and world.
+ */
+
+#define FMT_HEADER_ONLY
+#include <fmt/core.h>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Ensemble.h"
+
+struct SweepRange {
+    float min, max;
+
+    [[nodiscard]] float at(uint32_t i, uint32_t samples) const {
+        return samples < 2 ? min : min + (max - min) * float(i) / float(samples - 1);
+    }
+};
+
+int main(int argc, char** argv) {
+    const char* out = "ensemble.csv";
+    uint32_t steps = 600, samples = 10;
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    SweepRange radius{4.0f, 12.0f}, spacing{1.0f, 2.0f}, speed{0.5f, 3.0f};
+
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--out") == 0 && i + 1 < argc) out = argv[++i];
+        else if (std::strcmp(argv[i], "--steps") == 0 && i + 1 < argc) steps = std::stoul(argv[++i]);
+        else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) threads = std::stoul(argv[++i]);
+        else if (std::strcmp(argv[i], "--samples") == 0 && i + 1 < argc) samples = std::stoul(argv[++i]);
+        else if (i + 2 < argc) {
+            SweepRange* range = std::strcmp(argv[i], "--radius") == 0 ? &radius
+                              : std::strcmp(argv[i], "--spacing") == 0 ? &spacing
+                              : std::strcmp(argv[i], "--speed") == 0 ? &speed : nullptr;
+            if (!range) continue;
+            range->min = std::stof(argv[++i]);
+            range->max = std::stof(argv[++i]);
+        }
+    }
+
+    Ensemble ensemble;
+    std::vector<EnsembleScene> specs;
+    for (uint32_t r = 0; r < samples; r++) {
+        for (uint32_t s = 0; s < samples; s++) {
+            for (uint32_t v = 0; v < samples; v++) {
+                EnsembleScene scene{{1000.0f, 800.0f, radius.at(r, samples)}};
+                scene.spacing = spacing.at(s, samples);
+                scene.vy = -speed.at(v, samples);
+                specs.push_back(scene);
+                ensemble.addScene(scene);
+            }
+        }
+    }
+
+    ThreadPool pool(threads);
+    auto start = std::chrono::steady_clock::now();
+    ensemble.step(steps, pool);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    ensemble.writeResults(out, specs);
+    fmt::print("{} scenes, {} particles, {} steps in {:.3f} s ({:.0f} particle steps/s) -> {}\n",
+               ensemble.sceneCount(), ensemble.particleCount(), steps, seconds,
+               double(ensemble.particleCount()) * steps / seconds, out);
+    return EXIT_SUCCESS;
+}
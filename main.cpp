@@ -20,6 +20,16 @@
  *      -> release cell (x,y) mutex
  *  -> barrier 2
  *  -> signal all threads finished
+ *
+ * the barriers are the pool's start and join waits: spin with pause for a calibrated
+ * window, then keep spinning, yield or sleep (--idle spin|yield|sleep)
+ *
+ * frame (frameLoop), the simulation one frame ahead of the screen:
+ *  -> the step of frame N + 1 runs on the step thread, the pool's caller. The dense
+ *     grid step is itself a task graph over bands of grid rows, the workers pack each
+ *     band's positions into the back vertex buffer once the step is done with it,
+ *     then publish the frame to shared memory and the spatial queries
+ *  -> meanwhile the GL thread uploads and draws frame N from the front buffer
  */
 
 
@@ -36,6 +46,17 @@
 #include <vector>
 #include <chrono>
 #include <sstream>
+#include <charconv>
+#include <cstring>
+#include "ParticleSim.h"
+#include "SharedState.h"
+#include "ControlServer.h"
+#include "SpatialQuery.h"
+#include "TaskGraph.h"
+#include "FramePipeline.h"
+#include "FrameRecorder.h"
+#include "RealTime.h"
+#include "Validation.h"
 
 const char *vertexShaderSource = "#version 450 core\n"
                                  "layout (location = 0) in vec3 inPos;\n"
@@ -76,9 +97,15 @@ public:
     static constexpr int HEIGHT = 800;
     const std::string appName = "Thread collisions";
     static constexpr uint32_t PARTICLE_COUNT = 512;
+    // Spawns beyond this are refused, so the shared memory ring always holds the whole world
+    static constexpr uint32_t MAX_PARTICLES = 1u << 16;
     static constexpr float radius = 8.0f;
 
-    ParticleCollisionDemo() {
+    static SolverConfig defaultConfig() {
+        return {float(WIDTH), float(HEIGHT), radius};
+    }
+
+    explicit ParticleCollisionDemo(const SolverConfig& config = defaultConfig()) : world(config) {
         // Initialize glfw
         if (!glfwInit())
             exit(EXIT_FAILURE);
@@ -102,6 +129,7 @@ public:
             exit(EXIT_FAILURE);
         }
 
+        registerInputCallbacks();
     }
 
     ~ParticleCollisionDemo() {
@@ -162,6 +190,7 @@ public:
             particle.position = accPos;
             particle.velocity = glm::vec3(0.0f, -1.0f, 0.0f);
             particle.color = glm::vec4(0.2f, 0.6f, 1.0f, 1.0f);
+            world.addParticle(particle.position.x, particle.position.y, particle.velocity.x, particle.velocity.y);
 
             accPos.x += radius*1.2f;
 
@@ -171,6 +200,7 @@ public:
             }
 
         }
+        packed = particles;
 
         glGenVertexArrays(1, &VAO);
         glBindVertexArray(VAO);
@@ -180,6 +210,7 @@ public:
 
 
         glBufferData(GL_ARRAY_BUFFER, particles.size()*sizeof(Particle), particles.data(), GL_DYNAMIC_DRAW);
+        uploadedCount = particles.size();
 
         // position
         glEnableVertexAttribArray(0);
@@ -228,6 +259,31 @@ public:
         createShaders();
         createPoints();
 
+        // The loop only blocks here, waiting for a step or a write to finish, or for its own next frame
+        PipelineTask loop = frameLoop();
+        while (!loop.done()) resumes.waitAndPump();
+    }
+
+    /*
+     * One iteration per frame:
+     *  -> input, then wait for the step the last frame started; its positions are the
+     *     front vertex buffer now
+     *  -> with no step running: record and checkpoint that frame, apply the commands
+     *  -> start the next step, then upload and render the front buffer while it runs
+     * The recording and checkpoint writes are handed to the AsyncWriter and finish
+     * while the next frames run, as many as its buffers hold; past that the loop
+     * suspends until a write completes and frees one.
+     */
+    PipelineTask frameLoop() {
+        // The pool's loops are started from the step thread, so that is the one to make real-time
+        if (realTime) {
+            bool entered = false;
+            co_await stepThread.run([&] { entered = enterRealTime(world, *realTime); });
+            if (!entered) exit(EXIT_FAILURE);
+            jitter.emplace(realTime->budget);
+            world.threads().trackWaits(true);
+        }
+
         auto currentTime = std::chrono::high_resolution_clock::now();
         float deltaTime, accTime = 0;
         uint32_t frames = 0;
@@ -246,6 +302,29 @@ public:
             frames++;
 
             glfwPollEvents();
+            queueToolAction();
+
+            co_await stepDepth.acquire();
+            if (recorder) co_await recorder->record(world.arrays(), world.frame());
+            if (checkpointer && world.frame() >= nextCheckpoint) {
+                co_await checkpointer->record(world.arrays(), world.frame());
+                nextCheckpoint = world.frame() + CHECKPOINT_INTERVAL;
+            }
+            applyCommands();
+            stats.store({world.frame(), uint32_t(world.size()), paused, stepMilliseconds, world.config().radius,
+                         uint32_t(world.contactCount())});
+            const float pointSize = 2*world.config().radius;
+            if (!paused || pendingSteps > 0) {
+                if (paused) pendingSteps--;
+                stepping = stepFrame();
+            } else {
+                // Tools and spawns still move particles while paused
+                for (size_t i = 0; i < particles.size(); i++) {
+                    particles[i].position.x = world.x()[i];
+                    particles[i].position.y = world.y()[i];
+                }
+                stepDepth.release();
+            }
 
             glClearColor(0.05f, 0.1f, 0.1f, 1.0f);
             glClear(GL_COLOR_BUFFER_BIT);
@@ -258,9 +337,9 @@ public:
             GLint proj = glGetUniformLocation(shaderProgram, "projMatrix");
             glUniformMatrix4fv(proj, 1, GL_FALSE, glm::value_ptr(projMatrix));
 
-            updateParticles();
+            uploadVertices();
 
-            glPointSize(2*radius);
+            glPointSize(pointSize);
             glDrawArrays(GL_POINTS, 0, size);
 
             // Display FPS
@@ -276,49 +355,252 @@ public:
                 accTime = 0.0f;
             }
             glfwSwapBuffers(window);
+
+            // Let run() handle the steps and writes that finished meanwhile
+            co_await resumes.yield();
+        }
+
+        co_await stepDepth.acquire();
+        if (recorder) co_await recorder->flush();
+        if (checkpointer) co_await checkpointer->flush();
+        if (jitter) {
+            std::cout << "real-time:\n";
+            jitter->print(std::cout, world.threads().waitStats().wake);
+        }
+        if (validator) {
+            std::cout << "validation:\n";
+            validator->print(std::cout);
+        }
+    }
+
+    // Publish every completed frame to shared memory for out of process readers
+    void publishTo(const std::string& name) {
+        publisher.emplace(name, MAX_PARTICLES);
+    }
+
+    // Mouse tools: 1/2/3 pick attract/repel/drag, hold the left button to apply, scroll to resize
+    void registerInputCallbacks() {
+        glfwSetWindowUserPointer(window, this);
+        glfwSetCursorPosCallback(window, [](GLFWwindow* w, double x, double y) {
+            auto* demo = static_cast<ParticleCollisionDemo*>(glfwGetWindowUserPointer(w));
+            // the projection puts y = 0 at the bottom, GLFW counts from the top
+            demo->cursor = glm::vec2(float(x), float(HEIGHT) - float(y));
+        });
+        glfwSetMouseButtonCallback(window, [](GLFWwindow* w, int button, int action, int) {
+            auto* demo = static_cast<ParticleCollisionDemo*>(glfwGetWindowUserPointer(w));
+            if (button == GLFW_MOUSE_BUTTON_LEFT) demo->toolHeld = action == GLFW_PRESS;
+        });
+        glfwSetScrollCallback(window, [](GLFWwindow* w, double, double dy) {
+            auto* demo = static_cast<ParticleCollisionDemo*>(glfwGetWindowUserPointer(w));
+            demo->toolRadius = std::clamp(demo->toolRadius * (dy > 0 ? 1.1f : 1 / 1.1f), 2 * radius, float(WIDTH));
+        });
+        glfwSetKeyCallback(window, [](GLFWwindow* w, int key, int, int action, int) {
+            auto* demo = static_cast<ParticleCollisionDemo*>(glfwGetWindowUserPointer(w));
+            if (action != GLFW_PRESS) return;
+            if (key == GLFW_KEY_1) demo->tool = ToolKind::Attract;
+            else if (key == GLFW_KEY_2) demo->tool = ToolKind::Repel;
+            else if (key == GLFW_KEY_3) demo->tool = ToolKind::Drag;
+        });
+    }
+
+    // Turns the held mouse tool into a command, so it reaches the particles between steps
+    void queueToolAction() {
+        glm::vec2 cursorVelocity(cursor.x - lastCursor.x, cursor.y - lastCursor.y);
+        lastCursor = cursor;
+        if (!toolHeld) return;
+
+        Command command{Command::Type::Tool};
+        command.tool = {tool, cursor.x, cursor.y, toolRadius, TOOL_STRENGTH, cursorVelocity.x, cursorVelocity.y};
+        commands.push(std::move(command));
+    }
+
+    void addForceField(const ForceField& field) {
+        if (!world.forces().add(field)) exit(EXIT_FAILURE);
+    }
+
+    // Parallel loops on pool, openmp or stdpar
+    void useBackend(const std::string& name) {
+        auto backend = parseBackend(name);
+        if (!backend || !world.threads().setBackend(*backend)) {
+            std::cout << "ERROR::BACKEND::UNAVAILABLE\n" << name << std::endl;
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // Workers between loops spin, yield or sleep after the calibrated spin window
+    void useIdleStrategy(const std::string& name) {
+        auto strategy = parseIdleStrategy(name);
+        if (!strategy) {
+            std::cout << "ERROR::IDLE::UNKNOWN_STRATEGY\n" << name << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        world.threads().setIdlePolicy({*strategy});
+    }
+
+    // Locked memory and SCHED_FIFO workers on cores ("2,3" or "any"), step jitter printed on exit
+    void useRealTime(const std::string& cores) {
+        auto list = parseCores(cores);
+        if (!list) {
+            std::cout << "ERROR::REALTIME::BAD_CORES\n" << cores << std::endl;
+            exit(EXIT_FAILURE);
         }
+        realTime.emplace();
+        realTime->cores = *list;
+    }
 
+    // Every step checked against the reference solver, the first one off by more than tolerance reported
+    void useValidation(const std::string& tolerance) {
+        double value{};
+        auto [end, error] = std::from_chars(tolerance.data(), tolerance.data() + tolerance.size(), value);
+        if (error != std::errc() || end != tolerance.data() + tolerance.size() || !(value >= 0)) {
+            std::cout << "ERROR::VALIDATE::BAD_TOLERANCE\n" << tolerance << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        validator.emplace(world.config(), value);
     }
 
-    void updateParticles(){
-        for (auto& particle : particles) {
-            particle.position += particle.velocity;
+    // Every frame's positions, appended to path
+    void recordTo(const std::string& path) {
+        openWriter();
+        recorder.emplace(path, FrameRecorder::Mode::Append, false, *writer, resumes);
+    }
 
-            for (auto& other : particles){
-                if (&other == &particle) continue;
+    // The full state every CHECKPOINT_INTERVAL frames, rewriting path
+    void checkpointTo(const std::string& path) {
+        openWriter();
+        checkpointer.emplace(path, FrameRecorder::Mode::Overwrite, true, *writer, resumes);
+    }
 
-                auto vec = particle.position - other.position;
-                if (glm::dot(vec, vec) < radius*radius){
-                    float distToMove = (radius - glm::length(vec))/2;
-                    vec = glm::normalize(vec);
-                    other.position -= vec*distToMove;
-                    particle.position += vec*distToMove;
+    // Output goes through io_uring or pwrite threads; main applies it before --record and --checkpoint
+    void useWriter(const std::string& name) {
+        auto backend = parseWriterBackend(name);
+        if (!backend) {
+            std::cout << "ERROR::WRITER::BAD_BACKEND\n" << name << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        if (writer) {
+            std::cout << "ERROR::WRITER::ALREADY_OPEN\n" << "--writer " << name << " given after another --writer" << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        writerBackend = *backend;
+        openWriter();
+    }
+
+    void openWriter() {
+        if (writer) return;
+        writer.emplace(resumes, writerBackend);
+        if (writerBackend != WriterBackend::Auto && writer->backend() != writerBackend) {
+            std::cout << "ERROR::WRITER::UNAVAILABLE\n" << writerBackendName(writerBackend) << std::endl;
+            exit(EXIT_FAILURE);
+        }
+    }
 
+    // Accept commands from a local socket, applied between steps by applyCommands()
+    void serveControl(const std::string& socketPath) {
+        controlServer.emplace(socketPath, commands, stats, MAX_PARTICLES);
+    }
 
-                    other.velocity = glm::vec3(0.0f);
-                    particle.velocity = glm::vec3(0.0f);
+    void applyCommands() {
+        commands.drain(drainedCommands);
+        for (auto& command : drainedCommands) {
+            switch (command.type) {
+                case Command::Type::Pause:
+                    paused = true;
+                    break;
+                case Command::Type::Resume:
+                    paused = false;
+                    pendingSteps = 0;
+                    break;
+                case Command::Type::Step:
+                    // Steps sent while running are ignored, a later Pause must not run them
+                    if (paused) pendingSteps += command.steps;
+                    break;
+                case Command::Type::SetParameter: {
+                    auto config = world.config();
+                    if (!applyParameter(config, command.parameter, command.value)) break;
+                    if (!periodsFit(config)) {
+                        std::cout << "ERROR::CONTROL::PERIOD_TOO_SMALL\n" << config.width << " x " << config.height
+                                  << " cannot wrap particles of radius " << config.radius << std::endl;
+                        break;
+                    }
+                    world.setConfig(config);
+                    if (validator) validator->setConfig(config);
+                    break;
                 }
+                case Command::Type::Spawn:
+                    if (world.size() + command.particles.size() > MAX_PARTICLES) {
+                        std::cout << "ERROR::CONTROL::SPAWN_OVER_LIMIT\n" << world.size() << " + "
+                                  << command.particles.size() << " particles, at most " << MAX_PARTICLES << std::endl;
+                        break;
+                    }
+                    for (size_t i = 0; i < command.particles.size(); i++) {
+                        auto& spawned = command.particles;
+                        world.addParticle(spawned.x[i], spawned.y[i], spawned.vx[i], spawned.vy[i]);
+                        Particle particle;
+                        particle.position = glm::vec3(spawned.x[i], spawned.y[i], 0.0f);
+                        particle.color = glm::vec4(1.0f, 0.6f, 0.2f, 1.0f);
+                        particles.push_back(particle);
+                        packed.push_back(particle);
+                    }
+                    break;
+                case Command::Type::Tool:
+                    world.applyTool(command.tool);
+                    break;
             }
+        }
+    }
+
+    // Steps on the step thread into the back vertex buffer, which becomes the front one once done
+    PipelineTask stepFrame() {
+        co_await stepThread.run([this] { stepWorld(); });
+        particles.swap(packed);
+        stepDepth.release();
+    }
 
-            if (particle.position.x < 0.0f) {
-                particle.position.x = 0.0f;
-                particle.velocity.x = -particle.velocity.x;
-            } else if (particle.position.x > WIDTH) {
-                particle.position.x = WIDTH;
-                particle.velocity.x = -particle.velocity.x;
+    // Runs on the step thread, which has the world and the back buffer to itself until it returns
+    void stepWorld() {
+        RegionFn pack = [this](std::span<const uint32_t> region, unsigned) {
+            for (uint32_t i : region) {
+                packed[i].position.x = world.x()[i];
+                packed[i].position.y = world.y()[i];
             }
-            if (particle.position.y < 0.0f) {
-                particle.position.y = 0.0f;
-                particle.velocity.y = -particle.velocity.y;
-            } else if (particle.position.y > HEIGHT) {
-                particle.position.y = HEIGHT;
-                particle.velocity.y = -particle.velocity.y;
+        };
+        auto stepStart = std::chrono::high_resolution_clock::now();
+        if (!validator) {
+            world.step(1, pack);
+        } else if (!validatedStep(world, *validator, 1, pack) && validator->firstDivergence()->step == validator->steps()) {
+            const Divergence& divergence = *validator->firstDivergence();
+            std::cout << "VALIDATION::DIVERGED\nstep " << divergence.step << " (frame " << world.frame() << "), particle "
+                      << divergence.particle << ", position off by " << divergence.position << std::endl;
+        }
+        auto stepTime = std::chrono::high_resolution_clock::now() - stepStart;
+        stepMilliseconds = std::chrono::duration<float, std::chrono::milliseconds::period>(stepTime).count();
+        if (jitter) {
+            jitter->addStep(uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(stepTime).count()));
+            // Frames come at the display's pace, a frame started more than a budget after the last is late
+            if (lastStep != decltype(lastStep){}) {
+                auto late = std::chrono::duration_cast<std::chrono::nanoseconds>(stepStart - lastStep) - realTime->budget;
+                jitter->addWake(uint64_t(std::max<int64_t>(0, late.count())));
             }
+            lastStep = stepStart;
         }
 
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glBufferData(GL_ARRAY_BUFFER, particles.size()*sizeof(Particle), particles.data(), GL_DYNAMIC_DRAW);
+        frameGraph.clear();
+        if (publisher) frameGraph.add([&](unsigned) { publisher->publish(world.arrays(), world.frame()); });
+        frameGraph.add([&](unsigned) { queries.publish(world.arrays(), world.config(), world.frame()); });
+        frameGraph.run(world.threads());
+    }
 
+    void uploadVertices() {
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        if (particles.size() != uploadedCount) {
+            // Spawned particles grow the buffer
+            glBufferData(GL_ARRAY_BUFFER, particles.size()*sizeof(Particle), particles.data(), GL_DYNAMIC_DRAW);
+            uploadedCount = particles.size();
+        } else {
+            glBufferSubData(GL_ARRAY_BUFFER, 0, GLsizeiptr(particles.size()*sizeof(Particle)), particles.data());
+        }
+        size = (int) particles.size();
     }
 
 
@@ -327,12 +609,77 @@ private:
     GLuint shaderProgram{};
     GLuint VBO{}, VAO{};
     std::vector<Particle> particles{PARTICLE_COUNT};
+    // Where the step packs the next frame while particles is uploaded and drawn
+    std::vector<Particle> packed;
+    ParticleWorld world;
+    std::optional<StatePublisher> publisher;
+    float stepMilliseconds{};
+    TaskGraph frameGraph;
+    size_t uploadedCount{};
+
+    static constexpr uint64_t CHECKPOINT_INTERVAL = 600;
+    ResumeQueue resumes;
+    // One step at a time, the world is only touched between steps
+    DepthLimit stepDepth{resumes, 1};
+    JobThread stepThread{resumes};
+    PipelineTask stepping;
+    WriterBackend writerBackend = WriterBackend::Auto;
+    std::optional<AsyncWriter> writer;
+    std::optional<FrameRecorder> recorder, checkpointer;
+    std::optional<RealTimeConfig> realTime;
+    std::optional<JitterStats> jitter;
+    std::optional<DifferentialValidator<float>> validator;
+    std::chrono::high_resolution_clock::time_point lastStep;
+    uint64_t nextCheckpoint{};
+
+    CommandQueue commands;
+    std::vector<Command> drainedCommands;
+    StatsBoard stats;
+    std::optional<ControlServer> controlServer;
+    SpatialQueries queries;
+    bool paused = false;
+    uint32_t pendingSteps{};
+
+    static constexpr float TOOL_STRENGTH = 0.5f;
+    ToolKind tool = ToolKind::Attract;
+    bool toolHeld = false;
+    float toolRadius = 60.0f;
+    glm::vec2 cursor{}, lastCursor{};
     int size{};
     struct cudaGraphicsResource* cudaVbo{};
 };
 
-int main() {
-    ParticleCollisionDemo example;
+int main(int argc, char** argv) {
+    auto config = ParticleCollisionDemo::defaultConfig();
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--periodic-x") == 0) config.boundaryX = BoundaryMode::Periodic;
+        else if (std::strcmp(argv[i], "--periodic-y") == 0) config.boundaryY = BoundaryMode::Periodic;
+        else if (std::strcmp(argv[i], "--periodic") == 0) config.boundaryX = config.boundaryY = BoundaryMode::Periodic;
+        else if (std::strcmp(argv[i], "--hashed-grid") == 0) config.gridMode = GridMode::Hashed;
+        else if (std::strcmp(argv[i], "--sweep-and-prune") == 0) config.broadPhase = BroadPhase::SweepAndPrune;
+    }
+
+    ParticleCollisionDemo example(config);
+    // The writer has to exist before --record or --checkpoint open their files on it, wherever it was given
+    for (int i = 1; i + 1 < argc; i++) {
+        if (std::strcmp(argv[i], "--writer") == 0) example.useWriter(argv[i + 1]);
+    }
+    for (int i = 1; i + 1 < argc; i++) {
+        if (std::strcmp(argv[i], "--publish") == 0) example.publishTo(argv[i + 1]);
+        else if (std::strcmp(argv[i], "--control") == 0) example.serveControl(argv[i + 1]);
+        else if (std::strcmp(argv[i], "--record") == 0) example.recordTo(argv[i + 1]);
+        else if (std::strcmp(argv[i], "--backend") == 0) example.useBackend(argv[i + 1]);
+        else if (std::strcmp(argv[i], "--idle") == 0) example.useIdleStrategy(argv[i + 1]);
+        else if (std::strcmp(argv[i], "--realtime") == 0) example.useRealTime(argv[i + 1]);
+        else if (std::strcmp(argv[i], "--checkpoint") == 0) example.checkpointTo(argv[i + 1]);
+        else if (std::strcmp(argv[i], "--validate") == 0) example.useValidation(argv[i + 1]);
+        else if (std::strcmp(argv[i], "--gravity") == 0) {
+            example.addForceField({FieldKind::Gravity, 0.0f, -std::stof(argv[i + 1])});
+        } else if (std::strcmp(argv[i], "--vortex") == 0) {
+            float x = ParticleCollisionDemo::WIDTH / 2.0f, y = ParticleCollisionDemo::HEIGHT / 2.0f;
+            example.addForceField({FieldKind::Vortex, x, y, std::stof(argv[i + 1]), y});
+        }
+    }
 
     example.run();
 